@@ -0,0 +1,217 @@
+// PixelNut Frame Codec Class Implementation
+/*
+    Copyright (c) 2015-2024, Greg de Valois
+    Software License Agreement (BSD License)
+    See license.txt for the terms of this license.
+*/
+
+#include <PixelNutLib.h>
+
+#define DEBUG_OUTPUT 0 // 1 to debug this file
+#if DEBUG_OUTPUT
+#define DBG(x) x
+#define DBGOUT(x) pixelNutSupport.msgFormat x
+#else
+#define DBG(x)
+#define DBGOUT(x)
+#endif
+
+// fewer unchanged bytes or repeated pixels than these are just included in a literal,
+// which also keeps the encoded frame from being more than CODEC_MAX_OVERHEAD bigger
+#define MIN_SKIP_BYTES            4
+#define MIN_REPEAT_PIXELS         3
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Internal helper routines
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// appends variable length value to output, returns false if not enough room
+static bool PutValue(byte **pptr, byte *pend, uint32_t value)
+{
+  byte *p = *pptr;
+  do
+  {
+    if (p >= pend) return false;
+    byte b = (value & 0x7F);
+    value >>= 7;
+    *p++ = (value ? (b | 0x80) : b);
+  }
+  while (value);
+
+  *pptr = p;
+  return true;
+}
+
+// reads variable length value from input, returns false if not valid
+static bool GetValue(const byte **pptr, const byte *pend, uint32_t *pvalue)
+{
+  const byte *p = *pptr;
+  uint32_t value = 0;
+
+  for (int shift = 0; shift < 32; shift += 7)
+  {
+    if (p >= pend) return false;
+    byte b = *p++;
+    value |= ((uint32_t)(b & 0x7F) << shift);
+    if (!(b & 0x80))
+    {
+      *pptr = p;
+      *pvalue = value;
+      return true;
+    }
+  }
+  return false; // too many bytes
+}
+
+static bool PutToken(byte **pptr, byte *pend, byte type, uint32_t count)
+{
+  return PutValue(pptr, pend, ((count << 2) | type));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Public interface routines
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PixelNutCodec::PixelNutCodec(uint32_t frame_bytes, bool encoder)
+{
+  frameBytes = frame_bytes;
+
+  if (encoder)
+  {
+    pPrevFrame = (byte*)malloc(frame_bytes);
+    reset();
+  }
+}
+
+PixelNutCodec::~PixelNutCodec()
+{
+  if (pPrevFrame != NULL) free(pPrevFrame);
+}
+
+void PixelNutCodec::reset(void)
+{
+  if (pPrevFrame != NULL) memset(pPrevFrame, 0, frameBytes);
+}
+
+uint32_t PixelNutCodec::encodeFrame(const byte *pframe, byte *pout, uint32_t maxlen)
+{
+  if (pPrevFrame == NULL) return 0;
+
+  byte *pprev = pPrevFrame;
+  byte *p = pout;
+  byte *pend = pout + maxlen;
+
+  // frames can be larger than an int (up to 65535 pixels)
+  int32_t framebytes = frameBytes;
+  int32_t pos = 0;
+  int32_t litstart = -1; // start of literal bytes not written yet
+
+  while (pos < framebytes)
+  {
+    int32_t zeros = 0; // count unchanged bytes
+    while (((pos + zeros) < framebytes) && (pframe[pos + zeros] == pprev[pos + zeros])) ++zeros;
+    if ((pos + zeros) >= framebytes) break; // rest is unchanged
+
+    // count pixels that change in the same way as the one at this position
+    int32_t reps = 0;
+    if (zeros < MIN_SKIP_BYTES)
+    {
+      int32_t next = pos + PIXEL_CHANNELS;
+      while ((next + PIXEL_CHANNELS) <= framebytes)
+      {
+        int i = 0;
+        for (; i < PIXEL_CHANNELS; ++i)
+          if ((pframe[next+i] ^ pprev[next+i]) != (pframe[pos+i] ^ pprev[pos+i])) break;
+        if (i < PIXEL_CHANNELS) break;
+        next += PIXEL_CHANNELS;
+      }
+      reps = ((next - pos) / PIXEL_CHANNELS);
+    }
+
+    if ((zeros >= MIN_SKIP_BYTES) || (reps >= MIN_REPEAT_PIXELS))
+    {
+      if (litstart >= 0) // first write out the literal bytes before this
+      {
+        if (!PutToken(&p, pend, CODEC_TOKEN_LITERAL, (pos - litstart))) return 0;
+        if ((pend - p) < (pos - litstart)) return 0;
+        for (int32_t i = litstart; i < pos; ++i) *p++ = (pframe[i] ^ pprev[i]);
+        litstart = -1;
+      }
+
+      if (zeros >= MIN_SKIP_BYTES)
+      {
+        if (!PutToken(&p, pend, CODEC_TOKEN_SKIP, zeros)) return 0;
+        pos += zeros;
+      }
+      else
+      {
+        if (!PutToken(&p, pend, CODEC_TOKEN_REPEAT, reps)) return 0;
+        if ((pend - p) < PIXEL_CHANNELS) return 0;
+        for (int i = 0; i < PIXEL_CHANNELS; ++i) *p++ = (pframe[pos+i] ^ pprev[pos+i]);
+        pos += (reps * PIXEL_CHANNELS);
+      }
+    }
+    else // short runs of unchanged bytes are included in the literal
+    {
+      if (litstart < 0) litstart = pos;
+      pos += (zeros + 1);
+    }
+  }
+
+  if (litstart >= 0) // write out remaining literal bytes
+  {
+    if (!PutToken(&p, pend, CODEC_TOKEN_LITERAL, (pos - litstart))) return 0;
+    if ((pend - p) < (pos - litstart)) return 0;
+    for (int32_t i = litstart; i < pos; ++i) *p++ = (pframe[i] ^ pprev[i]);
+  }
+
+  if (!PutToken(&p, pend, CODEC_TOKEN_END, 0)) return 0;
+
+  memcpy(pPrevFrame, pframe, frameBytes);
+
+  DBGOUT((F("Encoded frame: %lu => %d bytes"), (unsigned long)frameBytes, (p - pout)));
+  return (p - pout);
+}
+
+uint32_t PixelNutCodec::decodeFrame(const byte *pin, uint32_t inlen, byte *pframe)
+{
+  const byte *p = pin;
+  const byte *pend = pin + inlen;
+  uint32_t pos = 0;
+
+  while (true)
+  {
+    uint32_t value;
+    if (!GetValue(&p, pend, &value)) return 0;
+
+    uint32_t count = (value >> 2);
+    switch (value & 3)
+    {
+      case CODEC_TOKEN_SKIP:
+      {
+        if (count > (frameBytes - pos)) return 0;
+        pos += count;
+        break;
+      }
+      case CODEC_TOKEN_LITERAL:
+      {
+        if ((count > (frameBytes - pos)) || (count > (uint32_t)(pend - p))) return 0;
+        for (uint32_t i = 0; i < count; ++i) pframe[pos++] ^= *p++;
+        break;
+      }
+      case CODEC_TOKEN_REPEAT:
+      {
+        if ((count > ((frameBytes - pos) / PIXEL_CHANNELS)) || ((pend - p) < PIXEL_CHANNELS)) return 0;
+        for (uint32_t i = 0; i < count; ++i)
+          for (int j = 0; j < PIXEL_CHANNELS; ++j)
+            pframe[pos++] ^= p[j];
+        p += PIXEL_CHANNELS;
+        break;
+      }
+      default: // CODEC_TOKEN_END
+      {
+        return (p - pin);
+      }
+    }
+  }
+}
@@ -46,6 +46,11 @@ C_ASSERT(sizeof(CometHeadData) == 4);
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+uint16_t PixelNutComets::cometHeadBytes(uint16_t headcount)
+{
+  return (sizeof(CometHeadData) + (headcount * sizeof(CometHead)));
+}
+
 PixelNutComets::cometData PixelNutComets::cometHeadCreate(uint16_t headcount)
 {
   void *memptr;
@@ -53,8 +58,8 @@ PixelNutComets::cometData PixelNutComets::cometHeadCreate(uint16_t headcount)
 
   while(1)
   {
-    memlen = (sizeof(CometHeadData) + (headcount * sizeof(CometHead)));
-    memptr = malloc(memlen);
+    memlen = cometHeadBytes(headcount);
+    memptr = pixelNutSupport.memAlloc(memlen);
     if (memptr != NULL) break;
 
     DBGOUT ((F("Cannot allocate %d bytes for comet heads"), memlen));
@@ -83,12 +88,12 @@ void PixelNutComets::cometHeadDelete(PixelNutComets::cometData cdata)
   if (pData != NULL)
   {
     DBGOUT((F("Freed data for %d comet heads: %d in use"), pData->count, pData->inuse));
-    free(pData);
+    pixelNutSupport.memFree(pData);
   }
 }
 
 // adds new head or overwrites existing one if no more room, returns number of heads currently in use
-int PixelNutComets::cometHeadAdd(PixelNutComets::cometData cdata, byte layer, bool dowrap, uint16_t pixlen)
+int PixelNutComets::cometHeadAdd(PixelNutComets::cometData cdata, uint16_t layer, bool dowrap, uint16_t pixlen)
 {
   if (cdata == NULL) return 0;
 
@@ -194,7 +199,7 @@ int PixelNutComets::cometHeadAdd(PixelNutComets::cometData cdata, byte layer, bo
 }
 
 // draws all valid comet heads, returns number of heads currently in use
-int PixelNutComets::cometHeadDraw(PixelNutComets::cometData cdata, byte layer,
+int PixelNutComets::cometHeadDraw(PixelNutComets::cometData cdata, uint16_t layer,
                                   PixelNutSupport::DrawProps *pdraw,
                                   PixelNutHandle handle, uint16_t pixlen)
 {
@@ -18,6 +18,26 @@ extern PluginFactory *pPluginFactory; // use externally declared pointer to inst
 #define DBGOUT(x)
 #endif
 
+// sets what memory allocated after this is charged to: an effect layer or the engine itself
+#if PIXELNUT_MEMSTATS
+#define MEM_CHARGE(layer) { pixelNutSupport.memHandle = this; pixelNutSupport.memLayer = (layer); }
+#define MEM_NOCHARGE()    { pixelNutSupport.memHandle = NULL; }
+#else
+#define MEM_CHARGE(layer)
+#define MEM_NOCHARGE()
+#endif
+#define MEM_ENGINE        MAX_WORD_VALUE
+
+// records a call from the application if a journal is being kept
+#define JOURNAL(...) { if (pJournal != NULL) pJournal->record(__VA_ARGS__); }
+
+// calls the application at the start and end of a region of work if it's being profiled
+#if PIXELNUT_PROFILE
+#define PROFILE(...) { if (profileFunc != NULL) profileFunc(__VA_ARGS__); }
+#else
+#define PROFILE(...)
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Constructor: initialize class variables, allocate memory for layer/track stacks
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -36,21 +56,37 @@ PixelNutEngine::PixelNutEngine(byte *ptr_pixels, uint16_t num_pixels, bool goupw
   maxPluginLayers = num_layers;
   maxPluginTracks = num_tracks;
 
-  pluginLayers = (PluginLayer*)malloc(num_layers * sizeof(PluginLayer));
-  pluginTracks = (PluginTrack*)malloc(num_tracks * sizeof(PluginTrack));
+  MEM_CHARGE(MEM_ENGINE);
+  pluginLayers = (PluginLayer*)pixelNutSupport.memAlloc(num_layers * sizeof(PluginLayer));
+  pluginTracks = (PluginTrack*)pixelNutSupport.memAlloc(num_tracks * sizeof(PluginTrack));
+  segTracks    = (uint16_t*)pixelNutSupport.memAlloc(num_tracks * sizeof(uint16_t));
 
   if ((ptr_pixels == NULL) || (num_pixels == 0) ||
-    (pluginLayers == NULL) || (pluginTracks == NULL))
+    (pluginLayers == NULL) || (pluginTracks == NULL) || (segTracks == NULL))
        pDrawPixels = NULL; // caller must test for this
   else pDrawPixels = pDisplayPixels;
 }
 
+PixelNutEngine::~PixelNutEngine()
+{
+  DeleteLayers(); // not clearStack(): the pixels may already be gone
+
+  MEM_CHARGE(MEM_ENGINE);
+  pixelNutSupport.memFree(pluginLayers);
+  pixelNutSupport.memFree(pluginTracks);
+  pixelNutSupport.memFree(segTracks);
+  pixelNutSupport.memFree(segStarts);
+  pixelNutSupport.memFree(loopHashes);
+  pixelNutSupport.memFree(pGroupPixels);
+  MEM_NOCHARGE(); // cannot be charged to this anymore
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Internal string to numeric value handling routines
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 // set or toggle value according to char at 'str'
-static bool GetBoolValue(char *str, bool curval)
+static bool GetBoolValue(const char *str, bool curval)
 {
   if (*str == '0') return false;
   if (*str == '1') return true;
@@ -58,10 +94,11 @@ static bool GetBoolValue(char *str, bool curval)
 }
 
 // returns -1 if no value, or not in range 0-'maxval'
-static int GetNumValue(char *str, int maxval)
+// (values are long so that MAX_WORD_VALUE fits where int is only 16 bits)
+static long GetNumValue(const char *str, long maxval)
 {
   if ((str == NULL) || !isdigit(*str)) return -1;
-  int newval = atoi(str);
+  long newval = atol(str);
   if (newval > maxval) return -1;
   if (newval < 0) return -1;
   return newval;
@@ -69,10 +106,10 @@ static int GetNumValue(char *str, int maxval)
 
 // clips values to range 0-'maxval'
 // returns 'curval' if no value is specified
-static int GetNumValue(char *str, int curval, int maxval)
+static long GetNumValue(const char *str, long curval, long maxval)
 {
   if ((str == NULL) || !isdigit(*str)) return curval;
-  int newval = atoi(str);
+  long newval = atol(str);
   if (newval > maxval) return maxval;
   if (newval < 0) return 0;
   return newval;
@@ -86,17 +123,41 @@ static int GetNumValue(char *str, int curval, int maxval)
 
 void PixelNutEngine::clearStack(void)
 {
+  if (pJournal != NULL)
+  {
+    JournalState();
+    pJournal->record(JOURNAL_CLEAR);
+  }
+
   DBGOUT((F("Clear stack: layer=%d track=%d"), indexLayerStack, indexTrackStack));
 
+  loopDeclared = false; // any loop was for the previous pattern
+  LoopReset();
+
+  DeleteLayers();
+
+  segOffset = 0; // reset the track limits
+  segCount = numPixels;
+  numSegments = 0;
+  trigIndexValid = false;
+
+  // clear all pixels too
+  memset(pDisplayPixels, 0, (numPixels*PIXEL_CHANNELS));
+}
+
+// internal: deletes the effects and buffers of all of the tracks, leaving the stacks empty
+void PixelNutEngine::DeleteLayers(void)
+{
   for (int i = indexTrackStack; i >= 0; --i)
   {
-    DBGOUT((F("  Layer %d: track=%d"), i, pluginLayers[i].track));
+    DBGOUT((F("  Track %d: layer=%d"), i, pluginTracks[i].layer));
 
     // delete in reverse order: first the layer plugins
     int count = 0;
-    for (int j = pluginTracks[i].layer; j < indexLayerStack; ++j)
+    for (int j = pluginTracks[i].layer; j <= indexLayerStack; ++j)
     {
       ++count;
+      MEM_CHARGE(j);
       delete pluginLayers[j].pPlugin;
     }
     indexLayerStack -= count;
@@ -104,34 +165,126 @@ void PixelNutEngine::clearStack(void)
     // then the track buffer
     if (pluginTracks[i].pRedrawBuff != NULL)
     {
-      DBGOUT((F("Freeing pixel buffer: track=%d"), indexTrackStack));
-      free(pluginTracks[i].pRedrawBuff);
+      DBGOUT((F("Freeing pixel buffer: track=%d"), i));
+      MEM_CHARGE(pluginTracks[i].layer);
+      if (pluginTracks[i].sparse)
+        pixelNutSupport.memFree(((PixelNutSupport::SparsePixels*)pluginTracks[i].pRedrawBuff)->pixels);
+      pixelNutSupport.memFree(pluginTracks[i].pRedrawBuff);
     }
   }
 
   indexTrackEnable = -1;
   indexLayerStack  = -1;
   indexTrackStack  = -1;
+}
 
-  segOffset = 0; // reset the track limits
-  segCount = numPixels;
+// internal: doubles the size of the layer stack, and the track stack if adding a new track,
+// if they are full, up to MAX_TRACK_LAYER. Returns false if they are full and cannot be grown.
+bool PixelNutEngine::GrowStacks(bool newtrack)
+{
+  MEM_CHARGE(MEM_ENGINE);
 
-  // clear all pixels too
-  memset(pDisplayPixels, 0, (numPixels*3));
+  if ((indexLayerStack+1) >= maxPluginLayers)
+  {
+    short count = ((maxPluginLayers > 0) ? (maxPluginLayers * 2) : 4);
+    if (count > MAX_TRACK_LAYER) count = MAX_TRACK_LAYER;
+    if (count <= maxPluginLayers) return false;
+
+    PluginLayer *p = (PluginLayer*)pixelNutSupport.memRealloc(pluginLayers, (count * sizeof(PluginLayer)));
+    if (p == NULL) return false;
+
+    DBGOUT((F("Grew layer stack: %d => %d"), maxPluginLayers, count));
+    pluginLayers = p;
+    maxPluginLayers = count;
+  }
+
+  if (newtrack && ((indexTrackStack+1) >= maxPluginTracks))
+  {
+    short count = ((maxPluginTracks > 0) ? (maxPluginTracks * 2) : 4);
+    if (count > MAX_TRACK_LAYER) count = MAX_TRACK_LAYER;
+    if (count <= maxPluginTracks) return false;
+
+    PluginTrack *p = (PluginTrack*)pixelNutSupport.memRealloc(pluginTracks, (count * sizeof(PluginTrack)));
+    if (p == NULL) return false;
+    pluginTracks = p;
+
+    // the segment index must hold all of the tracks too
+    uint16_t *q = (uint16_t*)pixelNutSupport.memRealloc(segTracks, (count * sizeof(uint16_t)));
+    if (q == NULL) return false;
+    segTracks = q;
+
+    DBGOUT((F("Grew track stack: %d => %d"), maxPluginTracks, count));
+    maxPluginTracks = count;
+  }
+
+  return true;
+}
+
+template <typename T> static void Swap(T *a, T *b) { T t = *a; *a = *b; *b = t; }
+
+// internal: exchanges the current pattern with the one in 'pstacks', so that a new pattern
+// can be loaded while the current one is set aside, and then either one of them kept
+void PixelNutEngine::SwapStacks(PatternStacks *pstacks)
+{
+  Swap(&pluginLayers,     &pstacks->pluginLayers);
+  Swap(&pluginTracks,     &pstacks->pluginTracks);
+  Swap(&segTracks,        &pstacks->segTracks);
+  Swap(&segStarts,        &pstacks->segStarts);
+  Swap(&maxPluginLayers,  &pstacks->maxPluginLayers);
+  Swap(&indexLayerStack,  &pstacks->indexLayerStack);
+  Swap(&indexTrackEnable, &pstacks->indexTrackEnable);
+  Swap(&maxPluginTracks,  &pstacks->maxPluginTracks);
+  Swap(&indexTrackStack,  &pstacks->indexTrackStack);
+  Swap(&numSegments,      &pstacks->numSegments);
+  Swap(&maxSegments,      &pstacks->maxSegments);
+  Swap(&segOffset,        &pstacks->segOffset);
+  Swap(&segCount,         &pstacks->segCount);
+  Swap(&loopPeriod,       &pstacks->loopPeriod);
+  Swap(&loopDeclared,     &pstacks->loopDeclared);
+}
+
+// internal: pops off all layers, then frees the stacks themselves (which are
+// allocated again by GrowStacks() as they're needed)
+void PixelNutEngine::FreeStacks(void)
+{
+  PixelNutJournal *pjournal = pJournal; // part of a call that was already recorded
+  pJournal = NULL;
+  clearStack();
+  pJournal = pjournal;
+
+  MEM_CHARGE(MEM_ENGINE);
+  pixelNutSupport.memFree(pluginLayers);
+  pixelNutSupport.memFree(pluginTracks);
+  pixelNutSupport.memFree(segTracks);
+  pixelNutSupport.memFree(segStarts);
+
+  pluginLayers = NULL;
+  pluginTracks = NULL;
+  segTracks = NULL;
+  segStarts = NULL;
+  maxPluginLayers = 0;
+  maxPluginTracks = 0;
+  maxSegments = 0;
 }
 
 // return false if unsuccessful for any reason
 PixelNutEngine::Status PixelNutEngine::NewPluginLayer(int plugin, int segindex)
 {
-  // check if can add another layer to the stack
-  if ((indexLayerStack+1) >= maxPluginLayers)
+  // check if can add another layer to the stack (assume a new track will be needed)
+  if (((indexLayerStack+1) >= maxPluginLayers) && !GrowStacks(false))
   {
     DBGOUT((F("Cannot add another layer: max=%d"), (indexLayerStack+1)));
     return Status_Error_Memory;
   }
 
+  // the new layer is cleared first so that everything allocated for it can be charged to it
+  memset(&pluginLayers[indexLayerStack+1], 0, sizeof(PluginLayer));
+  pluginLayers[indexLayerStack+1].plugin = plugin;
+  MEM_CHARGE(indexLayerStack+1);
+
+  PixelNutPlugin::newSize = 0; // set only if the plugin exists, even if it can't be created
   PixelNutPlugin *pPlugin = pPluginFactory->makePlugin(plugin);
-  if (pPlugin == NULL) return Status_Error_BadVal;
+  if (pPlugin == NULL) return (PixelNutPlugin::newSize ? Status_Error_Memory : Status_Error_BadVal);
 
   // determine if must allocate buffer for track, or is a filter plugin
   bool newtrack = (pPlugin->gettype() & PLUGIN_TYPE_REDRAW);
@@ -142,8 +295,9 @@ PixelNutEngine::Status PixelNutEngine::NewPluginLayer(int plugin, int segindex)
   // a filter plugin and there is at least one redraw plugin, or
   // a redraw plugin and cannot add another track to the stack
   if ((!newtrack && (indexTrackStack < 0)) ||
-      ( newtrack && ((indexTrackStack+1) >= maxPluginTracks)))
+      ( newtrack && ((indexTrackStack+1) >= maxPluginTracks) && !GrowStacks(true)))
   {
+    MEM_CHARGE(indexLayerStack+1);
     delete pPlugin;
 
     if (newtrack)
@@ -158,8 +312,7 @@ PixelNutEngine::Status PixelNutEngine::NewPluginLayer(int plugin, int segindex)
     }
   }
 
-  ++indexLayerStack; // stack another effect layer
-  memset(&pluginLayers[indexLayerStack], 0, sizeof(PluginLayer));
+  ++indexLayerStack; // stack another effect layer (cleared above)
 
   if (newtrack)
   {
@@ -189,7 +342,9 @@ PixelNutEngine::Status PixelNutEngine::NewPluginLayer(int plugin, int segindex)
   pLayer->pPlugin       = pPlugin;
   pLayer->trigCount     = -1; // forever
   pLayer->trigDelayMin  = 1;  // 1 sec min
-  pLayer->trigSource    = MAX_BYTE_VALUE; // disabled
+  pLayer->trigSource    = MAX_WORD_VALUE; // disabled
+  pLayer->trigNext      = MAX_WORD_VALUE;
+  pLayer->trigFirst     = MAX_WORD_VALUE;
   pLayer->trigForce     = curForce; // used currently set force for default
   // Note: all other trigger parameters are initialized to 0
 
@@ -197,12 +352,15 @@ PixelNutEngine::Status PixelNutEngine::NewPluginLayer(int plugin, int segindex)
         plugin, pPlugin->gettype(), indexLayerStack, indexTrackStack));
 
   // begin new plugin, but will not be drawn until triggered
+  MEM_CHARGE(indexLayerStack);
   pPlugin->begin(indexLayerStack, segCount);
 
   if (newtrack) // wait to do this until after any memory allocation in plugin
   {
-    int numbytes = segCount*3;
-    byte *p = (byte*)malloc(numbytes);
+    // sparse tracks start out empty and grow as pixels are lit
+    bool sparse = (pPlugin->gettype() & PLUGIN_TYPE_SPARSE);
+    int numbytes = (sparse ? sizeof(PixelNutSupport::SparsePixels) : segCount*PIXEL_CHANNELS);
+    byte *p = (byte*)pixelNutSupport.memAlloc(numbytes);
 
     if (p == NULL)
     {
@@ -218,46 +376,224 @@ PixelNutEngine::Status PixelNutEngine::NewPluginLayer(int plugin, int segindex)
 
     memset(p, 0, numbytes);
     pluginTracks[indexTrackStack].pRedrawBuff = p;
+    pluginTracks[indexTrackStack].sparse = sparse;
+  }
+  else if (!(pPlugin->gettype() & PLUGIN_TYPE_POSTDRAW))
+  {
+    // a drawing effect with only a single predraw effect, right after it, can be stepped
+    // together with that by a fused kernel, which draws exactly the same pixels
+    PluginTrack *pTrack = &pluginTracks[indexTrackStack];
+    pTrack->fusedStep = (((indexLayerStack == (pTrack->layer + 1)) && !pTrack->sparse) ?
+                          pPluginFactory->makeFused(pluginLayers[pTrack->layer].plugin, plugin) : NULL);
+
+    DBG( if (pTrack->fusedStep != NULL) DBGOUT((F("Fused track %d with layer %d"), indexTrackStack, indexLayerStack)); )
   }
 
   return Status_Success;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Strip length handling routines
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// internal: moves a segment at 'poffset' with 'pcount' pixels onto a strip of 'num_pixels':
+// one that covers the whole strip still does, while others keep their place but are cut short
+// (or moved back to the last pixel) if they no longer fit
+void PixelNutEngine::ResizeSegment(uint16_t *poffset, uint16_t *pcount, uint16_t num_pixels)
+{
+  if ((*poffset == 0) && (*pcount == numPixels)) *pcount = num_pixels;
+  else
+  {
+    if (*poffset >= num_pixels) *poffset = num_pixels-1;
+    if (*pcount > (num_pixels - *poffset)) *pcount = (num_pixels - *poffset);
+  }
+}
+
+bool PixelNutEngine::resize(byte *ptr_pixels, uint16_t num_pixels)
+{
+  if ((ptr_pixels == NULL) || (num_pixels == 0)) return false;
+
+  DBGOUT((F("Resize: pixels=%d => %d"), numPixels, num_pixels));
+
+  // first grow the buffers that need to be, so that if one can't be nothing else has changed
+  // (the ones that were grown are then just larger than they need to be)
+  for (int i = 0; i <= indexTrackStack; ++i)
+  {
+    PluginTrack *pTrack = &pluginTracks[i];
+    uint16_t offset = pTrack->segOffset;
+    uint16_t count = pTrack->segCount;
+    ResizeSegment(&offset, &count, num_pixels);
+
+    if (!pTrack->sparse && (count > pTrack->segCount))
+    {
+      MEM_CHARGE(pTrack->layer);
+      byte *p = (byte*)pixelNutSupport.memRealloc(pTrack->pRedrawBuff, (count * PIXEL_CHANNELS));
+      if (p == NULL)
+      {
+        DBGOUT((F("!!! Memory alloc for %d bytes failed !!!"), (count * PIXEL_CHANNELS)));
+        return false;
+      }
+
+      memset((p + (pTrack->segCount * PIXEL_CHANNELS)), 0, ((count - pTrack->segCount) * PIXEL_CHANNELS));
+      pTrack->pRedrawBuff = p;
+    }
+  }
+
+  if ((pGroupPixels != NULL) && (num_pixels > numPixels))
+  {
+    MEM_CHARGE(MEM_ENGINE);
+    byte *p = (byte*)pixelNutSupport.memRealloc(pGroupPixels, (num_pixels * PIXEL_CHANNELS));
+    if (p == NULL)
+    {
+      DBGOUT((F("!!! Memory alloc for %d bytes failed !!!"), (num_pixels * PIXEL_CHANNELS)));
+      return false;
+    }
+    pGroupPixels = p; // contents are cleared before each use
+  }
+
+  JOURNAL(JOURNAL_RESIZE, num_pixels);
+  LoopReset(); // must finish any playback at the previous length
+
+  uint32_t time = GetTime();
+
+  for (int i = 0; i <= indexTrackStack; ++i)
+  {
+    PluginTrack *pTrack = &pluginTracks[i];
+    uint16_t offset = pTrack->segOffset;
+    uint16_t count = pTrack->segCount;
+    ResizeSegment(&offset, &count, num_pixels);
+
+    if (pTrack->sparse) // remove the lit pixels that are now past the end
+    {
+      PixelNutSupport::SparsePixels *psparse = (PixelNutSupport::SparsePixels*)pTrack->pRedrawBuff;
+      int lit = 0;
+      for (int j = 0; j < psparse->count; ++j)
+        if (psparse->pixels[j].pos < count) psparse->pixels[lit++] = psparse->pixels[j];
+      psparse->count = lit;
+    }
+    else if (count < pTrack->segCount) // doesn't matter if it can't be shrunk
+    {
+      #if PIXELNUT_PLANAR // keep the start of each plane, now closer together
+      for (int c = 1; c < PIXEL_CHANNELS; ++c)
+        memmove((pTrack->pRedrawBuff + (c * count)), (pTrack->pRedrawBuff + (c * pTrack->segCount)), count);
+      #endif
+
+      MEM_CHARGE(pTrack->layer);
+      byte *p = (byte*)pixelNutSupport.memRealloc(pTrack->pRedrawBuff, (count * PIXEL_CHANNELS));
+      if (p != NULL) pTrack->pRedrawBuff = p;
+    }
+    #if PIXELNUT_PLANAR
+    else if (count > pTrack->segCount) // already grown above, but the planes must be moved apart
+    {
+      byte *p = pTrack->pRedrawBuff;
+      for (int c = (PIXEL_CHANNELS-1); c > 0; --c)
+        memmove((p + (c * count)), (p + (c * pTrack->segCount)), pTrack->segCount);
+      for (int c = 0; c < PIXEL_CHANNELS; ++c)
+        memset((p + (c * count) + pTrack->segCount), 0, (count - pTrack->segCount));
+    }
+    #endif
+
+    // keep the count in proportion, and the window the whole track if it was before
+    PixelNutSupport::DrawProps *pdraw = &pTrack->draw;
+    pdraw->pixCount = (((uint32_t)pdraw->pixCount * count) / pTrack->segCount);
+    if (pdraw->pixCount < 1) pdraw->pixCount = 1;
+    if (pdraw->pixLen == pTrack->segCount) pdraw->pixLen = count;
+    else if (pdraw->pixLen > count) pdraw->pixLen = count;
+    if (pdraw->pixStart >= count) pdraw->pixStart = 0;
+
+    pTrack->segOffset = offset;
+    pTrack->segCount = count;
+    pTrack->msTimeRedraw = time; // redraw immediately
+  }
+
+  ResizeSegment(&segOffset, &segCount, num_pixels); // for any layers added after this
+
+  if ((pGroupPixels != NULL) && (num_pixels < numPixels)) // doesn't matter if it can't be shrunk
+  {
+    MEM_CHARGE(MEM_ENGINE);
+    byte *p = (byte*)pixelNutSupport.memRealloc(pGroupPixels, (num_pixels * PIXEL_CHANNELS));
+    if (p != NULL) pGroupPixels = p;
+  }
+
+  numPixels = num_pixels;
+  pDisplayPixels = ptr_pixels;
+  pDrawPixels = ptr_pixels;
+
+  if (loopMaxFrames > 0) // allocated again for the new frame size
+  {
+    PixelNutJournal *pjournal = pJournal; // part of this call that was already recorded
+    pJournal = NULL;
+    bool declared = loopDeclared;
+    uint16_t period = loopPeriod;
+
+    if (setLoopCache(loopMaxFrames)) // keep any loop declared by the pattern
+    {
+      loopDeclared = declared;
+      if (declared) loopPeriod = period;
+    }
+    pJournal = pjournal;
+  }
+
+  // then tell each effect its new length, and trigger it again if it had been
+  for (int i = 0; i <= indexLayerStack; ++i)
+  {
+    PluginLayer *pLayer = &pluginLayers[i];
+    MEM_CHARGE(i);
+    pLayer->pPlugin->resize(i, pluginTracks[pLayer->track].segCount);
+
+    if (pLayer->trigActive)
+    {
+      short force = ((pLayer->trigForce >= 0) ?
+                      pLayer->trigForce : pixelNutSupport.randomValue(0, MAX_FORCE_VALUE+1));
+      triggerLayer(i, force);
+    }
+  }
+
+  memset(pDisplayPixels, 0, (numPixels*PIXEL_CHANNELS));
+  return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Trigger force handling routines
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void PixelNutEngine::triggerLayer(byte layer, short force)
+void PixelNutEngine::triggerLayer(uint16_t layer, short force)
 {
   PluginLayer *pLayer = &pluginLayers[layer];
   int track = pLayer->track;
   PluginTrack *pTrack = &pluginTracks[track];
 
+  // postdraw effects are treated the same as predraw here: neither draw when triggered
   bool predraw = !(pLayer->pPlugin->gettype() & PLUGIN_TYPE_REDRAW);
 
   DBGOUT((F("Trigger: layer=%d track=%d(L%d) force=%d"), layer, track, pTrack->layer, force));
 
-  short pixCount = 0;
-  short degreeHue = 0;
-  byte pcentWhite = 0;
+  LoopReset(); // frames may no longer repeat
 
-  // prevent predraw effect from overwriting properties if in extern mode
-  if (externPropMode)
-  {
-    pixCount = pTrack->draw.pixCount;
-    degreeHue = pTrack->draw.degreeHue;
-    pcentWhite = pTrack->draw.pcentWhite;
-  }
+  UpdateColorVals(pTrack); // plugin may use the drawing color
 
   byte *dptr = pDrawPixels;
-  pDrawPixels = (predraw ? NULL : pTrack->pRedrawBuff); // prevent drawing if not drawing effect
+  PixelNutSupport::SparsePixels *sptr = pDrawSparse;
+  pDrawPixels = ((predraw || pTrack->sparse) ? NULL : pTrack->pRedrawBuff); // prevent drawing if not drawing effect
+  pDrawSparse = ((predraw || !pTrack->sparse) ? NULL : (PixelNutSupport::SparsePixels*)pTrack->pRedrawBuff);
+  #if PIXELNUT_PLANAR
+  uint16_t planelen = drawPlaneLen;
+  drawPlaneLen = pTrack->segCount;
+  #endif
+  #if PIXELNUT_MEMSTATS
+  uint16_t memlayer = pixelNutSupport.memLayer; // may be triggered from another plugin
+  #endif
+  MEM_CHARGE(layer);
   pLayer->pPlugin->trigger(this, &pTrack->draw, force);
-  pDrawPixels = dptr; // restore to the previous value
-
-  if (externPropMode) RestorePropVals(pTrack, pixCount, degreeHue, pcentWhite);
+  MEM_CHARGE(memlayer);
+  pDrawPixels = dptr; // restore to the previous values
+  pDrawSparse = sptr;
+  #if PIXELNUT_PLANAR
+  drawPlaneLen = planelen;
+  #endif
 
   // if this is the drawing effect for the track then redraw immediately
-  if (!predraw) pTrack->msTimeRedraw = pixelNutSupport.getMsecs();
+  if (!predraw) pTrack->msTimeRedraw = GetTime();
 
   pLayer->trigActive = true; // layer has been triggered now
 }
@@ -284,21 +620,58 @@ void PixelNutEngine::CheckAutoTrigger(bool rollover)
                 pluginLayers[i].trigCount));
 
       short force = ((pluginLayers[i].trigForce >= 0) ?
-                      pluginLayers[i].trigForce : random(0, MAX_FORCE_VALUE+1));
+                      pluginLayers[i].trigForce : pixelNutSupport.randomValue(0, MAX_FORCE_VALUE+1));
 
       triggerLayer(i, force);
 
-      pluginLayers[i].trigTimeMsecs = timePrevUpdate +
-          (1000 * random(pluginLayers[i].trigDelayMin,
-                        (pluginLayers[i].trigDelayMin + pluginLayers[i].trigDelayRange+1)));
+      // in sync mode the next time is from when it was due, not when it happened
+      pluginLayers[i].trigTimeMsecs = AutoTrigTime(&pluginLayers[i],
+                          (syncMode ? pluginLayers[i].trigTimeMsecs : timePrevUpdate));
 
       if (pluginLayers[i].trigCount > 0) --pluginLayers[i].trigCount;
     }
   }
 }
 
+// internal: returns the time of the next automatic trigger of a layer after 'time', which is
+// a random number of seconds, or of parts of a beat if the layer is locked to the tempo
+uint32_t PixelNutEngine::AutoTrigTime(PluginLayer *pLayer, uint32_t time)
+{
+  uint32_t count = pixelNutSupport.randomValue(pLayer->trigDelayMin,
+                                               (pLayer->trigDelayMin + pLayer->trigDelayRange+1));
+
+  if (pLayer->trigBeatDivs && beatUsecs) return BeatTime(time, pLayer->trigBeatDivs, count);
+  return (time + (1000 * count));
+}
+
+// internal: returns the time of the 'count' step after 'time' of the tempo with each beat
+// divided into 'divs' steps, rounded up to the next msec (calculated in usecs so that the
+// steps don't drift from the beats)
+uint32_t PixelNutEngine::BeatTime(uint32_t time, byte divs, uint32_t count)
+{
+  int64_t step = (beatUsecs / divs);
+  if (step <= 0) step = 1;
+
+  // usecs since the beat, which may be before or after 'time'
+  int64_t usecs = (int64_t)(int32_t)(time - beatMsecs) * 1000;
+  int64_t steps = ((usecs >= 0) ? (usecs / step) : -(((-usecs) + step - 1) / step));
+
+  int64_t next = ((steps + count) * step);
+  next = ((next >= 0) ? ((next + 999) / 1000) : -((-next) / 1000));
+
+  uint32_t msecs = beatMsecs + (uint32_t)next;
+  return (msecs ? msecs : 1); // 0 is never a time that is set
+}
+
 // external: cause trigger if enabled in track
 void PixelNutEngine::triggerForce(short force)
+{
+  JOURNAL(JOURNAL_FORCE, force);
+  TriggerExtern(force);
+}
+
+// internal: triggers the layers enabled for external triggering
+void PixelNutEngine::TriggerExtern(short force)
 {
   curForce = force; // sets default for new patterns
 
@@ -307,12 +680,99 @@ void PixelNutEngine::triggerForce(short force)
       triggerLayer(i, force);
 }
 
-// internal: called from plugins
-void PixelNutEngine::triggerForce(byte layer, short force)
+// external: cause trigger if enabled in the layers of a logical segment
+void PixelNutEngine::triggerSegForce(byte segindex, short force)
+{
+  JOURNAL(JOURNAL_SEGFORCE, segindex, force);
+  if (segindex >= numSegments) return;
+
+  for (int i = segStarts[segindex]; i < segStarts[segindex+1]; ++i)
+  {
+    // the layers for each track start with its drawing effect and end before the next one
+    int track = segTracks[i];
+    int endlayer = ((track < indexTrackStack) ? pluginTracks[track+1].layer : (indexLayerStack+1));
+
+    for (int j = pluginTracks[track].layer; j < endlayer; ++j)
+      if (pluginLayers[j].trigExtern)
+        triggerLayer(j, force);
+  }
+}
+
+// internal: creates index of the tracks in each logical segment, ordered by the segment,
+// so that the segment controls only need to look at the tracks in that segment
+void PixelNutEngine::MakeSegIndex(void)
+{
+  short count = 0;
+  for (int i = 0; i <= indexTrackStack; ++i)
+    if (pluginTracks[i].segIndex >= count)
+      count = pluginTracks[i].segIndex + 1;
+
+  if ((count > maxSegments) || (segStarts == NULL))
+  {
+    MEM_CHARGE(MEM_ENGINE);
+    uint16_t *p = (uint16_t*)pixelNutSupport.memRealloc(segStarts, ((count + 1) * sizeof(uint16_t)));
+    if (p == NULL) { numSegments = 0; return; } // segment controls are ignored
+    segStarts = p;
+    maxSegments = count;
+  }
+
+  // count the tracks in each segment, then turn that into the starting index for each
+  memset(segStarts, 0, ((count + 1) * sizeof(uint16_t)));
+  for (int i = 0; i <= indexTrackStack; ++i)
+    ++segStarts[pluginTracks[i].segIndex + 1];
+
+  for (int i = 1; i <= count; ++i)
+    segStarts[i] += segStarts[i-1];
+
+  // fill in the tracks, in stack order within each segment, using the end of each as the
+  // next index to fill, so each ends up at the start of the following segment afterwards
+  for (int i = 0; i <= indexTrackStack; ++i)
+    segTracks[segStarts[pluginTracks[i].segIndex]++] = i;
+
+  for (int i = count; i > 0; --i)
+    segStarts[i] = segStarts[i-1];
+  segStarts[0] = 0;
+
+  numSegments = count;
+  DBGOUT((F("Segment index: segments=%d tracks=%d"), numSegments, indexTrackStack+1));
+}
+
+// internal: links together the layers that are triggered by each layer, so that
+// sending a force doesn't have to look at every layer in the stack
+void PixelNutEngine::MakeTrigIndex(void)
 {
   for (int i = 0; i <= indexLayerStack; ++i)
-    if (layer == pluginLayers[i].trigSource)
+    pluginLayers[i].trigFirst = MAX_WORD_VALUE;
+
+  // go backwards so that the layers are triggered in stack order
+  for (int i = indexLayerStack; i >= 0; --i)
+  {
+    uint16_t source = pluginLayers[i].trigSource;
+    if (source <= indexLayerStack)
+    {
+      pluginLayers[i].trigNext = pluginLayers[source].trigFirst;
+      pluginLayers[source].trigFirst = i;
+    }
+    else pluginLayers[i].trigNext = MAX_WORD_VALUE;
+  }
+
+  trigIndexValid = true;
+}
+
+// internal: called from plugins
+void PixelNutEngine::triggerForce(uint16_t layer, short force)
+{
+  if (!trigIndexValid) // while still parsing a pattern
+  {
+    for (int i = 0; i <= indexLayerStack; ++i)
+      if (layer == pluginLayers[i].trigSource)
+        triggerLayer(i, force);
+  }
+  else if (layer <= indexLayerStack)
+  {
+    for (uint16_t i = pluginLayers[layer].trigFirst; i != MAX_WORD_VALUE; i = pluginLayers[i].trigNext)
       triggerLayer(i, force);
+  }
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -321,127 +781,395 @@ void PixelNutEngine::triggerForce(byte layer, short force)
 
 void PixelNutEngine::setPropertyMode(bool enable)
 {
+  JOURNAL(JOURNAL_PROPMODE, enable);
   DBGOUT((F("Engine property mode: %s"), (enable ? "enabled" : "disabled")));
   externPropMode = enable;
+
+  for (int i = 0; i <= indexTrackStack; ++i)
+    SetPropLocks(pluginTracks + i);
+
+  LoopReset();
 }
 
-void PixelNutEngine::SetPropColor(void)
+// internal: sets the externally controlled property values for the 'bits' that are being
+// changed, if allowed for that track, but only marks the drawing color to be recalculated
+// just before it's next used, so that multiple changes in between cost only one conversion
+void PixelNutEngine::SetPropVals(PluginTrack *pTrack, byte bits, short hue, byte white, byte count_percent)
 {
-  DBGOUT((F("Engine color properties for tracks:")));
+  if (pTrack->disable) return;
+  bits &= pTrack->ctrlBits;
 
-  // adjust all tracks that allow extern control with Q command
-  for (int i = 0; i <= indexTrackStack; ++i)
+  if (bits & ExtControlBit_DegreeHue)
   {
-    PluginTrack *pTrack = (pluginTracks + i);
-    if (pTrack->disable) continue;
-
-    bool doset = false;
-
-    if (pTrack->ctrlBits & ExtControlBit_DegreeHue)
-    {
-      DBGOUT((F("  %d) hue: %d => %d"), i, pTrack->draw.degreeHue, externDegreeHue));
-      pTrack->draw.degreeHue = externDegreeHue;
-      doset = true;
-    }
+    DBGOUT((F("  hue: %d => %d"), pTrack->draw.degreeHue, hue));
+    pTrack->draw.degreeHue = hue;
+    pTrack->newColor = true;
+  }
 
-    if (pTrack->ctrlBits & ExtControlBit_PcentWhite)
-    {
-      DBGOUT((F("  %d) whiteness: %d%% => %d%%"), i, pTrack->draw.pcentWhite, externPcentWhite));
-      pTrack->draw.pcentWhite = externPcentWhite;
-      doset = true;
-    }
+  if (bits & ExtControlBit_PcentWhite)
+  {
+    DBGOUT((F("  whiteness: %d%% => %d%%"), pTrack->draw.pcentWhite, white));
+    pTrack->draw.pcentWhite = white;
+    pTrack->newColor = true;
+  }
 
-    if (doset) pixelNutSupport.makeColorVals(&pTrack->draw);
+  if (bits & ExtControlBit_PixCount)
+  {
+    uint16_t count = pixelNutSupport.mapValue(count_percent, 0, MAX_PERCENTAGE, 1, pTrack->segCount);
+    DBGOUT((F("  count: %d => %d"), pTrack->draw.pixCount, count));
+    pTrack->draw.pixCount = count;
   }
 }
 
-void PixelNutEngine::setColorProperty(short hue_degree, byte white_percent)
+// internal: recalculates the drawing color if it was changed by the above
+void PixelNutEngine::UpdateColorVals(PluginTrack *pTrack)
 {
-  externDegreeHue = pixelNutSupport.clipValue(hue_degree, 0, MAX_DEGREES_HUE);
-  externPcentWhite = pixelNutSupport.clipValue(white_percent, 0, MAX_PERCENTAGE);
-  if (externPropMode) SetPropColor();
+  if (pTrack->newColor)
+  {
+    pixelNutSupport.makeColorVals(&pTrack->draw);
+    pTrack->newColor = false;
+  }
 }
 
-void PixelNutEngine::SetPropCount(void)
+void PixelNutEngine::SetPropTracks(byte bits)
 {
-  DBGOUT((F("Engine pixel count property for tracks:")));
+  DBGOUT((F("Engine properties for tracks: bits=0x%02X"), bits));
+  LoopReset();
 
   // adjust all tracks that allow extern control with Q command
   for (int i = 0; i <= indexTrackStack; ++i)
-  {
-    PluginTrack *pTrack = (pluginTracks + i);
-    if (pTrack->disable) continue;
+    SetPropVals((pluginTracks + i), bits, externDegreeHue, externPcentWhite, externPcentCount);
+}
 
-    if (pTrack->ctrlBits & ExtControlBit_PixCount)
-    {
-      uint16_t count = pixelNutSupport.mapValue(externPcentCount, 0, MAX_PERCENTAGE, 1, pTrack->segCount);
-      DBGOUT((F("  %d) %d => %d"), i, pTrack->draw.pixCount, count));
-      pTrack->draw.pixCount = count;
-    }
-  }
+void PixelNutEngine::SetPropSegment(byte segindex, byte bits, short hue, byte white, byte count_percent)
+{
+  if (!externPropMode || (segindex >= numSegments)) return;
+  LoopReset();
+
+  DBGOUT((F("Engine properties for segment %d: bits=0x%02X"), segindex, bits));
+
+  hue = pixelNutSupport.clipValue(hue, 0, MAX_DEGREES_HUE);
+  white = pixelNutSupport.clipValue(white, 0, MAX_PERCENTAGE);
+  count_percent = pixelNutSupport.clipValue(count_percent, 0, MAX_PERCENTAGE);
+
+  for (int i = segStarts[segindex]; i < segStarts[segindex+1]; ++i)
+    SetPropVals((pluginTracks + segTracks[i]), bits, hue, white, count_percent);
+}
+
+void PixelNutEngine::setSegColorProperty(byte segindex, short hue_degree, byte white_percent)
+{
+  JOURNAL(JOURNAL_SEGCOLOR, segindex, hue_degree, white_percent);
+  SetPropSegment(segindex, (ExtControlBit_DegreeHue | ExtControlBit_PcentWhite), hue_degree, white_percent, 0);
+}
+
+void PixelNutEngine::setSegCountProperty(byte segindex, byte pixcount_percent)
+{
+  JOURNAL(JOURNAL_SEGCOUNT, segindex, pixcount_percent);
+  SetPropSegment(segindex, ExtControlBit_PixCount, 0, 0, pixcount_percent);
+}
+
+void PixelNutEngine::setSegProperties(byte segindex, short hue_degree, byte white_percent, byte pixcount_percent)
+{
+  JOURNAL(JOURNAL_SEGPROPS, segindex, hue_degree, white_percent, pixcount_percent);
+  SetPropSegment(segindex, ExtControlBit_All, hue_degree, white_percent, pixcount_percent);
+}
+
+void PixelNutEngine::setColorProperty(short hue_degree, byte white_percent)
+{
+  JOURNAL(JOURNAL_COLOR, hue_degree, white_percent);
+  externDegreeHue = pixelNutSupport.clipValue(hue_degree, 0, MAX_DEGREES_HUE);
+  externPcentWhite = pixelNutSupport.clipValue(white_percent, 0, MAX_PERCENTAGE);
+  if (externPropMode) SetPropTracks(ExtControlBit_DegreeHue | ExtControlBit_PcentWhite);
 }
 
 void PixelNutEngine::setCountProperty(byte pixcount_percent)
 {
+  JOURNAL(JOURNAL_COUNT, pixcount_percent);
   // clip and map value into a pixel count, dependent on the actual number of pixels
   externPcentCount = pixelNutSupport.clipValue(pixcount_percent, 0, MAX_PERCENTAGE);
-  if (externPropMode) SetPropCount();
+  if (externPropMode) SetPropTracks(ExtControlBit_PixCount);
 }
 
-// internal: restore property values for bits set for track
-void PixelNutEngine::RestorePropVals(PluginTrack *pTrack, uint16_t pixCount, uint16_t degreeHue, byte pcentWhite)
+void PixelNutEngine::setProperties(short hue_degree, byte white_percent, byte pixcount_percent)
 {
-  if (pTrack->disable) return;
+  JOURNAL(JOURNAL_PROPS, hue_degree, white_percent, pixcount_percent);
+  externDegreeHue = pixelNutSupport.clipValue(hue_degree, 0, MAX_DEGREES_HUE);
+  externPcentWhite = pixelNutSupport.clipValue(white_percent, 0, MAX_PERCENTAGE);
+  externPcentCount = pixelNutSupport.clipValue(pixcount_percent, 0, MAX_PERCENTAGE);
+  if (externPropMode) SetPropTracks(ExtControlBit_All);
+}
 
-  if (pTrack->ctrlBits & ExtControlBit_PixCount)
-    pTrack->draw.pixCount = pixCount;
+// internal: lock properties for bits set for track, preventing plugins from changing them
+void PixelNutEngine::SetPropLocks(PluginTrack *pTrack)
+{
+  pTrack->draw.extLocks = ((externPropMode && !pTrack->disable) ? pTrack->ctrlBits : 0);
+}
 
-  bool doset = false;
+#if PIXELNUT_MEMSTATS
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Memory accounting routines
+////////////////////////////////////////////////////////////////////////////////////////////////////
 
-  if ((pTrack->ctrlBits & ExtControlBit_DegreeHue) &&
-      (pTrack->draw.degreeHue != degreeHue))
-  {
-    //DBGOUT((F(">>hue: %d->%d"), pTrack->draw.degreeHue, degreeHue));
-    pTrack->draw.degreeHue = degreeHue;
-    doset = true;
-  }
+static void AddMemUsage(PixelNutEngine::MemUsage *pusage, int32_t bytes)
+{
+  pusage->bytes += bytes;
+  if (pusage->peak < pusage->bytes) pusage->peak = pusage->bytes;
+}
 
-  if ((pTrack->ctrlBits & ExtControlBit_PcentWhite) &&
-      (pTrack->draw.pcentWhite != pcentWhite))
+void PixelNutEngine::memCharge(uint16_t layer, int32_t bytes)
+{
+  if (layer == MEM_ENGINE) AddMemUsage(&memEngine, bytes);
+  else if (layer < maxPluginLayers)
   {
-    //DBGOUT((F(">>wht: %d->%d"), pTrack->draw.pcentWhite, pcentWhite));
-    pTrack->draw.pcentWhite = pcentWhite;
-    doset = true;
+    // the layer is packed, so its usage can't be updated in place through a pointer
+    MemUsage usage = pluginLayers[layer].memUsage;
+    AddMemUsage(&usage, bytes);
+    pluginLayers[layer].memUsage = usage;
   }
+  AddMemUsage(&memTotal, bytes);
+}
+
+bool PixelNutEngine::getLayerMemory(uint16_t layer, MemUsage *pusage, uint16_t *pplugin)
+{
+  if (layer > indexLayerStack) return false;
+
+  *pusage = pluginLayers[layer].memUsage;
+  *pplugin = pluginLayers[layer].plugin;
+  return true;
+}
+
+void PixelNutEngine::getEngineMemory(MemUsage *pengine, MemUsage *ptotal)
+{
+  *pengine = memEngine;
+  *ptotal = memTotal;
+}
 
-  if (doset) pixelNutSupport.makeColorVals(&pTrack->draw);
+void PixelNutEngine::resetMemPeaks(void)
+{
+  memEngine.peak = memEngine.bytes;
+  memTotal.peak = memTotal.bytes;
 }
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-// Main command handler and pixel buffer renderer
-// Uses all alpha characters except: L,R,S,Z
+// Frame loop cache routines
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-PixelNutEngine::Status PixelNutEngine::execCmdStr(char *cmdstr)
+bool PixelNutEngine::setLoopCache(uint16_t max_frames)
 {
-  Status status = Status_Success;
-
-  int segindex = -1; // logical segment index
+  JOURNAL(JOURNAL_LOOPCACHE, max_frames);
+  LoopReset();
+  loopPeriod = 0;
+  loopDeclared = false;
+
+  MEM_CHARGE(MEM_ENGINE);
+  pixelNutSupport.memFree(loopHashes);
+  loopHashes = NULL;
+  loopMaxFrames = 0;
+
+  if (max_frames == 0) return true;
+
+  // one allocation for all of it, with the frames last as they may be an odd size,
+  // which must not be larger than can be allocated at once
+  uint32_t framebytes = (uint32_t)numPixels * PIXEL_CHANNELS;
+  uint32_t perframe = sizeof(uint32_t) + sizeof(uint16_t) + framebytes;
+  if (perframe > ((size_t)-1 / max_frames))
+  {
+    DBGOUT((F("!!! Loop cache of %u frames is too large !!!"), max_frames));
+    return false;
+  }
+  size_t numbytes = (size_t)max_frames * perframe;
+  byte *p = (byte*)pixelNutSupport.memAlloc(numbytes);
+  if (p == NULL)
+  {
+    DBGOUT((F("!!! Memory alloc for %lu bytes failed !!!"), (unsigned long)numbytes));
+    return false;
+  }
 
-  for (int i = 0; cmdstr[i]; ++i) // convert to upper case
-    cmdstr[i] = toupper(cmdstr[i]);
+  loopHashes = (uint32_t*)p;
+  loopDelays = (uint16_t*)(p + (max_frames * sizeof(uint32_t)));
+  loopFrames = p + (max_frames * (sizeof(uint32_t) + sizeof(uint16_t)));
+  loopMaxFrames = max_frames;
 
-  char *cmd = strtok(cmdstr, " "); // separate options by spaces
+  DBGOUT((F("Loop cache: frames=%d bytes=%lu"), max_frames, (unsigned long)numbytes));
+  return true;
+}
 
-  if (cmd == NULL) return Status_Success; // ignore empty line
-  do
+// internal: called whenever something happens that can change the frames that are drawn,
+// which stops any playback and starts recording and looking for a loop again
+void PixelNutEngine::LoopReset(void)
+{
+  if (loopPlaying)
   {
-    PixelNutSupport::DrawProps *pdraw = NULL;
-    if (indexTrackStack >= 0) pdraw = &pluginTracks[indexTrackStack].draw;
+    DBGOUT((F("Loop playback stopped: frame=%d"), loopMatches));
+    loopPlaying = false;
+
+    // bring the effects up to the frame that was played last, so they continue from there
+    // (they were left at the end of the period when the playback started), without recording
+    uint16_t maxframes = loopMaxFrames;
+    loopMaxFrames = 0;
+    for (int i = loopMatches; i > 0; --i)
+      UpdateAtTime(NextEventTime(pixelNutSupport.getMsecs()));
+    loopMaxFrames = maxframes;
+
+    // then shift their timing to when that frame was actually displayed
+    uint32_t shift = loopTimeFrame - timePrevUpdate;
+    for (int i = 0; i <= indexTrackStack; ++i)
+      pluginTracks[i].msTimeRedraw += shift;
+    timePrevUpdate = loopTimeFrame;
+  }
 
-    DBGOUT((F(">> Cmd=%s len=%d curtrack=%d"), cmd, strlen(cmd), indexTrackStack));
+  loopCount = 0;
+  loopIndex = 0;
+  loopMatches = 0;
+  if (!loopDeclared) loopPeriod = 0;
+}
 
-    if (cmd[0] == 'X') // sets offset into output display of the current segment by index
+// internal: FNV-1a hash of the output pixels
+static uint32_t HashPixels(byte *ppixs, uint32_t count)
+{
+  uint32_t hash = 2166136261UL;
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    hash ^= ppixs[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+// internal: records the frame that was just drawn into the cache, and starts playback
+// once the last 2 periods of 'loopPeriod' frames have been found to repeat the ones
+// before them (and at least MIN_LOOP_MATCHES frames), or once the number of frames
+// declared by the pattern have been recorded
+void PixelNutEngine::LoopRecord(uint32_t time)
+{
+  // automatic triggering happens at random times, so never repeats, and the frames of some
+  // effects don't repeat exactly either, so aren't looked for unless the pattern declares it
+  for (int i = 0; i <= indexLayerStack; ++i)
+  {
+    if (pluginLayers[i].trigCount && (pluginLayers[i].trigTimeMsecs > 0)) return;
+    if (!loopDeclared && !pluginLayers[i].pPlugin->repeats()) return;
+  }
+
+  uint32_t framebytes = (uint32_t)numPixels * PIXEL_CHANNELS;
+  uint32_t hash = HashPixels(pDisplayPixels, framebytes);
+  uint32_t delay = (loopCount ? (time - loopTimeFrame) : 0);
+  loopTimeFrame = time;
+
+  if (!loopDeclared) // compare with frames before this one
+  {
+    if (loopPeriod && (hash == loopHashes[(loopIndex + loopMaxFrames - loopPeriod) % loopMaxFrames]))
+      ++loopMatches;
+    else
+    {
+      // find the shortest period that could repeat with this frame
+      loopPeriod = loopMatches = 0;
+      for (int i = 1; i <= loopCount; ++i)
+      {
+        if (hash == loopHashes[(loopIndex + loopMaxFrames - i) % loopMaxFrames])
+        {
+          loopPeriod = i;
+          loopMatches = 1;
+          break;
+        }
+      }
+    }
+  }
+
+  loopHashes[loopIndex] = hash;
+  loopDelays[loopIndex] = ((delay > MAX_WORD_VALUE) ? MAX_WORD_VALUE : delay);
+  memcpy((loopFrames + ((uint32_t)loopIndex * framebytes)), pDisplayPixels, framebytes);
+
+  if (++loopIndex >= loopMaxFrames) loopIndex = 0;
+  if (loopCount < loopMaxFrames) ++loopCount;
+
+  // a pattern that changes slowly can draw the same frame many times, so to avoid
+  // mistaking that for a loop the frames must repeat for some minimum number of frames
+  if (loopPeriod && (loopDeclared ? (loopCount >= loopPeriod) :
+                     ((loopMatches >= (2 * loopPeriod)) && (loopMatches >= MIN_LOOP_MATCHES))))
+  {
+    DBGOUT((F("Loop playback: period=%d frames"), loopPeriod));
+
+    // the next frame is the first one in the last period that was recorded
+    loopIndex = (loopIndex + loopMaxFrames - loopPeriod) % loopMaxFrames;
+    loopMatches = 0; // now counts frames played within the period
+    loopPlaying = true;
+  }
+}
+
+// internal: displays the next cached frame if it's time for it
+bool PixelNutEngine::LoopPlay(uint32_t time)
+{
+  // for a declared loop the first frame has no delay, so use that of the next one
+  uint16_t delay = loopDelays[loopIndex];
+  if (delay == 0) delay = loopDelays[(loopIndex + 1) % loopMaxFrames];
+
+  if ((time - loopTimeFrame) < delay) return false;
+  loopTimeFrame = time;
+
+  uint32_t framebytes = (uint32_t)numPixels * PIXEL_CHANNELS;
+  memcpy(pDisplayPixels, (loopFrames + ((uint32_t)loopIndex * framebytes)), framebytes);
+
+  // wrap around to the start of the period when played all of it
+  if (++loopMatches >= loopPeriod)
+  {
+    loopMatches = 0;
+    loopIndex = (loopIndex + loopMaxFrames - (loopPeriod-1)) % loopMaxFrames;
+  }
+  else if (++loopIndex >= loopMaxFrames) loopIndex = 0;
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Main command handler and pixel buffer renderer
+// Uses all alpha characters except: Z
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PixelNutEngine::Status PixelNutEngine::execCmdStr(char *cmdstr)
+{
+  PROFILE(PROFILE_COMMAND, 0, numPixels, true);
+  Status status = Status_Success;
+
+  int segindex = -1; // logical segment index
+
+  bool newpattern = false; // true once the current pattern has been set aside
+  PatternStacks prevStacks;
+
+  bool checkpoint = false; // true if recorded the settings for a new pattern
+  if (pJournal != NULL) // record it before it's changed by the parsing
+  {
+    for (const char *p = cmdstr; *p; ++p)
+      if ((toupper(*p) == 'P') && ((p == cmdstr) || (*(p-1) == ' ')))
+      {
+        JournalState(); // starts a new pattern
+        checkpoint = true;
+        break;
+      }
+
+    pJournal->recordCommand(cmdstr);
+  }
+
+  for (int i = 0; cmdstr[i]; ++i) // convert to upper case
+    cmdstr[i] = toupper(cmdstr[i]);
+
+  char *cmd = strtok(cmdstr, " "); // separate options by spaces
+
+  if (cmd == NULL) // ignore empty line
+  {
+    PROFILE(PROFILE_COMMAND, 0, numPixels, false);
+    return Status_Success;
+  }
+  trigIndexValid = false; // until finished parsing
+  LoopReset();
+  do
+  {
+    PixelNutSupport::DrawProps *pdraw = NULL;
+    if (indexTrackStack >= 0) pdraw = &pluginTracks[indexTrackStack].draw;
+
+    DBGOUT((F(">> Cmd=%s len=%d curtrack=%d"), cmd, strlen(cmd), indexTrackStack));
+
+    if (cmd[0] == 'X') // sets offset into output display of the current segment by index
     {
       int pos = GetNumValue(cmd+1, numPixels-1); // returns -1 if not within range
       if (pos >= 0) segOffset = pos;
@@ -471,9 +1199,33 @@ PixelNutEngine::Status PixelNutEngine::execCmdStr(char *cmdstr)
     }
     else if (cmd[0] == 'P') // Pop one or more plugins from the stack ('P' is same as 'P0': pop all)
     {
-      clearStack();
+      if (!newpattern) // keep the current pattern until the new one has been loaded
+      {
+        memset(&prevStacks, 0, sizeof(PatternStacks));
+        prevStacks.indexLayerStack  = -1;
+        prevStacks.indexTrackEnable = -1;
+        prevStacks.indexTrackStack  = -1;
+        prevStacks.segCount = numPixels;
+
+        SwapStacks(&prevStacks);
+        newpattern = true;
+      }
+      else
+      {
+        PixelNutJournal *pjournal = pJournal; // part of this call that was already recorded
+        pJournal = NULL;
+        clearStack();
+        pJournal = pjournal;
+      }
+
       timePrevUpdate = 0; // redisplay pixels after being cleared
     }
+    else if (cmd[0] == 'L') // declares the number of frames in the Loop of the pattern ("L" is same as "L0": none)
+    {
+      int count = GetNumValue(cmd+1, 0, MAX_WORD_VALUE);
+      loopPeriod = ((count <= loopMaxFrames) ? count : 0); // else still detected if possible
+      loopDeclared = (loopPeriod > 0);
+    }
     else if (pdraw != NULL)
     {
       switch (cmd[0])
@@ -500,6 +1252,32 @@ PixelNutEngine::Status PixelNutEngine::execCmdStr(char *cmdstr)
           pdraw->orPixelValues = !GetBoolValue(cmd+1, !pdraw->orPixelValues);
           break;
         }
+        case 'M': // Masks the tracks below the current one with its brightness ("M" is same as "M1", "M0" masks all)
+        {
+          PluginTrack *pTrack = &pluginTracks[indexTrackStack];
+          if (pTrack->sparse)
+          {
+            DBGOUT((F("Sparse track cannot be a mask: track=%d"), indexTrackStack));
+            status = Status_Error_BadCmd;
+            break;
+          }
+
+          int count = GetNumValue(cmd+1, 1, MASK_ALL_TRACKS-1);
+          if ((count > 0) && (pGroupPixels == NULL)) // needs the group buffer
+          {
+            MEM_CHARGE(MEM_ENGINE);
+            pGroupPixels = (byte*)pixelNutSupport.memAlloc(numPixels * PIXEL_CHANNELS);
+            if (pGroupPixels == NULL)
+            {
+              DBGOUT((F("!!! Memory alloc for %d bytes failed !!!"), (numPixels * PIXEL_CHANNELS)));
+              status = Status_Error_Memory;
+              break;
+            }
+          }
+
+          pTrack->maskCount = ((count > 0) ? count : MASK_ALL_TRACKS);
+          break;
+        }
         case 'H': // set the color Hue in the current track properties ("H" has no effect)
         {
           pdraw->degreeHue = GetNumValue(cmd+1, pdraw->degreeHue, MAX_DEGREES_HUE);
@@ -534,12 +1312,18 @@ PixelNutEngine::Status PixelNutEngine::execCmdStr(char *cmdstr)
           pdraw->msecsDelay = GetNumValue(cmd+1, pdraw->msecsDelay, MAX_DELAY_VALUE);
           break;
         }
+        case 'S': // redraws the current track in Steps of the tempo ("S" is same as "S1", "S0" uses the delay)
+        {
+          pluginTracks[indexTrackStack].beatSteps = GetNumValue(cmd+1, 1, MAX_BYTE_VALUE); // clip to 0-MAX_BYTE_VALUE
+          break;
+        }
         case 'Q': // set extern control bits ("Q" has no effect)
         {
           short bits = GetNumValue(cmd+1, ExtControlBit_All); // returns -1 if not within range
           if (bits >= 0)
           {
             pluginTracks[indexTrackStack].ctrlBits = bits;
+            SetPropLocks(&pluginTracks[indexTrackStack]);
             if (externPropMode)
             {
               if (bits & ExtControlBit_DegreeHue)
@@ -572,9 +1356,9 @@ PixelNutEngine::Status PixelNutEngine::execCmdStr(char *cmdstr)
           else pluginLayers[indexLayerStack].trigExtern = true;
           break;
         }
-        case 'A': // Assign effect layer as trigger source for current plugin layer ("A" is same as "A0", "A255" disables)
+        case 'A': // Assign effect layer as trigger source for current plugin layer ("A" is same as "A0", "A65535" disables)
         {
-          pluginLayers[indexLayerStack].trigSource = GetNumValue(cmd+1, 0, MAX_BYTE_VALUE); // clip to 0-MAX_BYTE_VALUE
+          pluginLayers[indexLayerStack].trigSource = GetNumValue(cmd+1, 0, MAX_WORD_VALUE); // clip to 0-MAX_WORD_VALUE
           DBGOUT((F("Triggering assigned to layer %d"), pluginLayers[indexLayerStack].trigSource));
           break;
         }
@@ -591,6 +1375,11 @@ PixelNutEngine::Status PixelNutEngine::execCmdStr(char *cmdstr)
           if (!pluginLayers[indexLayerStack].trigCount) pluginLayers[indexLayerStack].trigCount = -1;
           break;
         }
+        case 'R': // locks auto-triggering to the tempo, in parts of a beat ("R" is same as "R1", "R0" unlocks)
+        {
+          pluginLayers[indexLayerStack].trigBeatDivs = GetNumValue(cmd+1, 1, MAX_BYTE_VALUE); // clip to 0-MAX_BYTE_VALUE
+          break;
+        }
         case 'O': // sets minimum auto-triggering time ("O", "O0", "O1" all get set to default(1sec))
         {
           uint16_t min = GetNumValue(cmd+1, 1, MAX_WORD_VALUE); // clip to 0-MAX_WORD_VALUE
@@ -600,14 +1389,12 @@ PixelNutEngine::Status PixelNutEngine::execCmdStr(char *cmdstr)
         case 'T': // Trigger the current plugin layer, either once ("T") or with timer ("T<n>")
         {
           short force = pluginLayers[indexLayerStack].trigForce;
-          if (force < 0) force = random(0, MAX_FORCE_VALUE+1);
+          if (force < 0) force = pixelNutSupport.randomValue(0, MAX_FORCE_VALUE+1);
 
           if (isdigit(*(cmd+1))) // there is a value after "T"
           {
             pluginLayers[indexLayerStack].trigDelayRange = GetNumValue(cmd+1, 0, MAX_WORD_VALUE); // clip to 0-MAX_WORD_VALUE
-            pluginLayers[indexLayerStack].trigTimeMsecs = pixelNutSupport.getMsecs() +
-                (1000 * random(pluginLayers[indexLayerStack].trigDelayMin,
-                              (pluginLayers[indexLayerStack].trigDelayMin + pluginLayers[indexLayerStack].trigDelayRange+1)));
+            pluginLayers[indexLayerStack].trigTimeMsecs = AutoTrigTime(&pluginLayers[indexLayerStack], GetTime());
 
             DBGOUT((F("AutoTriggerSet: layer=%d delay=%u+%u count=%d force=%d"), indexLayerStack,
                       pluginLayers[indexLayerStack].trigDelayMin, pluginLayers[indexLayerStack].trigDelayRange,
@@ -645,17 +1432,663 @@ PixelNutEngine::Status PixelNutEngine::execCmdStr(char *cmdstr)
   }
   while (cmd != NULL);
 
+  if (newpattern)
+  {
+    DBGOUT((F("New pattern: status=%d layers=%d tracks=%d"), status, indexLayerStack+1, indexTrackStack+1));
+
+    if (status != Status_Success) // discard all of it and restore the previous pattern
+    {
+      FreeStacks();
+      SwapStacks(&prevStacks);
+    }
+    else // discard the previous pattern instead
+    {
+      SwapStacks(&prevStacks);
+      FreeStacks();
+      SwapStacks(&prevStacks);
+    }
+  }
+
+  // the previous pattern was kept, so it cannot be replayed from the new one
+  if (checkpoint && (status != Status_Success)) pJournal->failedState();
+
+  MakeSegIndex(); // tracks may have been added
+  MakeTrigIndex(); // and layers and trigger sources
+
   DBGOUT((F(">> Exec: status=%d"), status));
+  PROFILE(PROFILE_COMMAND, 0, numPixels, false);
   return status;
 }
 
+PixelNutEngine::Status PixelNutEngine::checkCmdStr(const char *cmdstr, PatternCost *pcost)
+{
+  memset(pcost, 0, sizeof(PatternCost));
+
+  // only the commands that affect what is allocated are looked at, using
+  // copies of the segment settings since these persist between commands
+  uint16_t segoffset = segOffset;
+  uint16_t segcount = segCount;
+  bool havetrack = (indexTrackStack >= 0);
+  bool newstacks = false;
+  bool needgroup = false; // group buffer is only allocated once
+
+  const char *cmd = cmdstr;
+  while (*cmd)
+  {
+    if (*cmd == ' ') { ++cmd; continue; }
+
+    switch (toupper(*cmd))
+    {
+      case 'X':
+      {
+        int pos = GetNumValue(cmd+1, numPixels-1);
+        segoffset = ((pos >= 0) ? pos : 0);
+        break;
+      }
+      case 'Y':
+      {
+        int count = GetNumValue(cmd+1, numPixels-segoffset);
+        segcount = ((count > 0) ? count : numPixels);
+        break;
+      }
+      case 'P': // only what follows this is loaded, into new stacks
+      {
+        memset(pcost, 0, sizeof(PatternCost));
+        segoffset = 0;
+        segcount = numPixels;
+        havetrack = false;
+        newstacks = true;
+        needgroup = false;
+        break;
+      }
+      case 'E':
+      {
+        int plugin = GetNumValue(cmd+1, MAX_PLUGIN_VALUE);
+        if (plugin < 0) return Status_Error_BadVal;
+
+        MEM_NOCHARGE(); // only created to ask it what it needs
+        PixelNutPlugin *pPlugin = pPluginFactory->makePlugin(plugin);
+        if (pPlugin == NULL) return Status_Error_BadVal;
+
+        uint32_t bytes;
+        pcost->cost  += pPlugin->getcost(segcount, &bytes);
+        pcost->bytes += bytes + PixelNutPlugin::newSize;
+        ++pcost->layers;
+
+        byte type = pPlugin->gettype();
+        delete pPlugin;
+
+        if (type & PLUGIN_TYPE_REDRAW)
+        {
+          pcost->bytes += ((type & PLUGIN_TYPE_SPARSE) ? sizeof(PixelNutSupport::SparsePixels) :
+                                                         (segcount * PIXEL_CHANNELS));
+          pcost->cost += segcount; // merging it into the output display
+          ++pcost->tracks;
+          havetrack = true;
+        }
+        else if (!havetrack) return Status_Error_BadCmd; // first plugin must be a track
+        break;
+      }
+      case 'M':
+      {
+        if (GetNumValue(cmd+1, 1, MASK_ALL_TRACKS-1) == 0) break; // masks the output display
+        if ((pGroupPixels == NULL) && !needgroup)
+          pcost->bytes += (numPixels * PIXEL_CHANNELS);
+        pcost->cost += numPixels; // merging the group into the output display
+        needgroup = true;
+        break;
+      }
+    }
+
+    while (*cmd && (*cmd != ' ')) ++cmd; // skip to next command
+  }
+
+  // add what the stacks grow by, doubling in size as GrowStacks() does
+  short numlayers = (newstacks ? 0 : maxPluginLayers);
+  short numtracks = (newstacks ? 0 : maxPluginTracks);
+  short count = numlayers;
+  while (count < ((newstacks ? 0 : (indexLayerStack+1)) + pcost->layers))
+    count = ((count > 0) ? (count * 2) : 4);
+  pcost->bytes += (count - numlayers) * sizeof(PluginLayer);
+
+  count = numtracks;
+  while (count < ((newstacks ? 0 : (indexTrackStack+1)) + pcost->tracks))
+    count = ((count > 0) ? (count * 2) : 4);
+  pcost->bytes += (count - numtracks) * (sizeof(PluginTrack) + sizeof(uint16_t)); // and segment index
+
+  DBGOUT((F("Check: layers=%d tracks=%d bytes=%lu cost=%lu"),
+          pcost->layers, pcost->tracks, pcost->bytes, pcost->cost));
+  return Status_Success;
+}
+
+// internal: merges the lit pixels of a sparse track that are within the output pixels
+// 'startpos'...'endpos' into 'pdisplay', mapping each into the same position as for a
+// track with a full pixel buffer
+void PixelNutEngine::MergeSparseTrack(PluginTrack *pTrack, byte *pdisplay, uint16_t startpos, uint16_t endpos)
+{
+  PixelNutSupport::SparsePixels *psparse = (PixelNutSupport::SparsePixels*)pTrack->pRedrawBuff;
+
+  int32_t pixlast = numPixels-1;
+  int32_t pixstart = pTrack->segOffset + pTrack->draw.pixStart;
+  if (pixstart > pixlast) pixstart -= (pixlast+1);
+
+  int32_t pixend = pixstart + pTrack->draw.pixLen - 1;
+  if (pixend > pixlast) pixend -= (pixlast+1);
+
+  for (int i = 0; i < psparse->count; ++i)
+  {
+    PixelNutSupport::SparsePixel *ppix = &psparse->pixels[i];
+
+    // offset of this pixel from the start of the drawing window
+    int32_t offset = ppix->pos - pTrack->draw.pixStart;
+    if (offset < 0) offset += numPixels;
+    if (offset >= pTrack->draw.pixLen) continue; // outside of window
+
+    int32_t pix;
+    if (pTrack->draw.goUpwards)
+    {
+      pix = pixstart + offset;
+      if (pix > pixlast) pix -= (pixlast+1);
+    }
+    else
+    {
+      pix = pixend - offset;
+      if (pix < 0) pix += (pixlast+1);
+    }
+    if ((pix < startpos) || (pix > endpos)) continue; // outside of block
+
+    byte *pout = pdisplay + (pix * PIXEL_CHANNELS);
+
+    if (pTrack->draw.orPixelValues)
+    {
+      pout[0] |= ppix->vals[0];
+      pout[1] |= ppix->vals[1];
+      pout[2] |= ppix->vals[2];
+      #if (PIXEL_CHANNELS == 4)
+      pout[3] |= ppix->vals[3];
+      #endif
+    }
+    else // lit pixels are never all 0
+    {
+      pout[0] = ppix->vals[0];
+      pout[1] = ppix->vals[1];
+      pout[2] = ppix->vals[2];
+      #if (PIXEL_CHANNELS == 4)
+      pout[3] = ppix->vals[3];
+      #endif
+    }
+  }
+}
+
+// internal: merges the pixels in the drawing window of a track that are within the output
+// pixels 'startpos'...'endpos' into 'pdisplay' (the output display or the group buffer),
+// or if 'mask' is set scales the pixels already merged there
+void PixelNutEngine::MergeTrack(PluginTrack *pTrack, byte *pdisplay, bool mask, uint16_t startpos, uint16_t endpos)
+{
+  // drawing window must start within the track's buffer, and not be empty
+  uint16_t pixlen = pTrack->draw.pixLen;
+  if (pixlen > pTrack->segCount) pixlen = pTrack->segCount;
+  if ((pixlen == 0) || (pTrack->draw.pixStart >= pTrack->segCount)) return;
+
+  // the values of each pixel are either together, or in separate planes that are only
+  // interleaved here, in the order of the output pixels
+  #if PIXELNUT_PLANAR
+  const uint16_t ystep = 1;
+  const uint16_t cstep = pTrack->segCount;
+  #else
+  const uint16_t ystep = PIXEL_CHANNELS;
+  const uint16_t cstep = 1;
+  #endif
+  byte *pbuff = pTrack->pRedrawBuff;
+  bool upwards = pTrack->draw.goUpwards;
+
+  uint16_t pixstart = pTrack->segOffset + pTrack->draw.pixStart;
+  if (pixstart >= numPixels) pixstart -= numPixels;
+
+  // the window may wrap around to the start of the strip, so it's in at most 2 runs
+  // of output pixels, and only the part of each run within the block is merged
+  uint16_t offset = 0; // of the run in the window
+  while (offset < pixlen)
+  {
+    uint32_t first = pixstart + offset;
+    if (first >= numPixels) first -= numPixels;
+
+    uint32_t count = pixlen - offset;
+    if (count > (numPixels - first)) count = (numPixels - first);
+    uint32_t last = first + count - 1;
+
+    uint16_t runoffset = offset;
+    offset += count;
+    if ((last < startpos) || (first > endpos)) continue;
+
+    uint32_t from = ((first > startpos) ? first : startpos);
+    uint32_t to   = ((last  < endpos)   ? last  : endpos);
+
+    // index of the first of those in the track's buffer, where the pixels are in the
+    // reverse order of the output pixels if drawing downwards
+    uint32_t y = runoffset + (from - first);
+    if (!upwards) y = (pixlen - 1) - y;
+    y += pTrack->draw.pixStart;
+    if (y >= pTrack->segCount) y -= pTrack->segCount;
+
+    byte *pout = pdisplay + (from * PIXEL_CHANNELS);
+    for (uint32_t pix = from; ; ++pix, pout += PIXEL_CHANNELS)
+    {
+      byte *pin = pbuff + (y * ystep);
+
+      if (mask) // scale the pixels merged so far by the brightest value of the mask
+      {
+        uint16_t level = pin[0];
+        if (level < pin[cstep])   level = pin[cstep];
+        if (level < pin[2*cstep]) level = pin[2*cstep];
+        #if (PIXEL_CHANNELS == 4)
+        if (level < pin[3*cstep]) level = pin[3*cstep];
+        #endif
+        ++level; // so that the brightest value leaves them unchanged
+
+        pout[0] = (pout[0] * level) >> 8;
+        pout[1] = (pout[1] * level) >> 8;
+        pout[2] = (pout[2] * level) >> 8;
+        #if (PIXEL_CHANNELS == 4)
+        pout[3] = (pout[3] * level) >> 8;
+        #endif
+      }
+      else if (pTrack->draw.orPixelValues)
+      {
+        // combine contents of buffer window with actual pixel array
+        pout[0] |= pin[0];
+        pout[1] |= pin[cstep];
+        pout[2] |= pin[2*cstep];
+        #if (PIXEL_CHANNELS == 4)
+        pout[3] |= pin[3*cstep];
+        #endif
+      }
+      #if (PIXEL_CHANNELS == 4)
+      else if ((pin[0] != 0) ||
+               (pin[cstep] != 0) ||
+               (pin[2*cstep] != 0) ||
+               (pin[3*cstep] != 0))
+      {
+        pout[0] = pin[0];
+        pout[1] = pin[cstep];
+        pout[2] = pin[2*cstep];
+        pout[3] = pin[3*cstep];
+      }
+      #else
+      else if ((pin[0] != 0) ||
+               (pin[cstep] != 0) ||
+               (pin[2*cstep] != 0))
+      {
+        pout[0] = pin[0];
+        pout[1] = pin[cstep];
+        pout[2] = pin[2*cstep];
+      }
+      #endif
+
+      if (pix == to) break;
+
+      if (upwards) // wrap around within the track's own buffer
+      {
+        if (++y >= pTrack->segCount) y = 0;
+      }
+      else if (y-- == 0) y = pTrack->segCount-1;
+    }
+  }
+}
+
+// internal: merges the output pixels 'startpos'...'endpos' of the group buffer into the
+// output display after it has been masked
+void PixelNutEngine::MergeGroup(bool orvalues, uint16_t startpos, uint16_t endpos)
+{
+  uint32_t first = (uint32_t)startpos * PIXEL_CHANNELS;
+  uint32_t count = (uint32_t)(endpos + 1) * PIXEL_CHANNELS;
+
+  if (orvalues)
+  {
+    for (uint32_t i = first; i < count; ++i)
+      pDisplayPixels[i] |= pGroupPixels[i];
+  }
+  else for (uint32_t i = first; i < count; i += PIXEL_CHANNELS)
+  {
+    #if (PIXEL_CHANNELS == 4)
+    if (pGroupPixels[i] || pGroupPixels[i+1] || pGroupPixels[i+2] || pGroupPixels[i+3])
+    #else
+    if (pGroupPixels[i] || pGroupPixels[i+1] || pGroupPixels[i+2])
+    #endif
+      memcpy((pDisplayPixels + i), (pGroupPixels + i), PIXEL_CHANNELS);
+  }
+}
+
+// internal: merges all of the enabled tracks into the output pixels 'startpos'...'endpos',
+// which are cleared first, so that each block of them is only written while it's in the cache
+void PixelNutEngine::MergeBlock(uint16_t startpos, uint16_t endpos)
+{
+  uint32_t first = (uint32_t)startpos * PIXEL_CHANNELS;
+  uint32_t count = (uint32_t)(endpos - startpos + 1) * PIXEL_CHANNELS;
+  memset((pDisplayPixels + first), 0, count); // must clear output buffer first
+
+  short masknext = -1;  // next track that is a mask (past the enabled tracks if none)
+  short groupstart = 0; // first track merged into the group buffer for that mask
+
+  PluginTrack *pTrack = pluginTracks;
+  for (int i = 0; i <= indexTrackStack; ++i, ++pTrack) // for each plugin that can redraw
+  {
+    if (i > indexTrackEnable) break; // at top of active layers now
+
+    if (!(pluginLayers[pTrack->layer].pPlugin->gettype() & PLUGIN_TYPE_REDRAW))
+      continue;
+
+    // tracks that a mask applies to are first merged into the group buffer, unless it
+    // masks all of the tracks below it, which are then already in the output display
+    if (i > masknext) // find the next mask track, and the first track in its group
+    {
+      masknext = i;
+      while ((masknext <= indexTrackEnable) && !pluginTracks[masknext].maskCount) ++masknext;
+      groupstart = masknext; // no group
+
+      if ((masknext <= indexTrackEnable) && (pGroupPixels != NULL) &&
+          (pluginTracks[masknext].maskCount != MASK_ALL_TRACKS))
+      {
+        // the group never includes the tracks before a previous mask
+        groupstart = masknext - pluginTracks[masknext].maskCount;
+        if (groupstart < i) groupstart = i;
+        memset((pGroupPixels + first), 0, count);
+      }
+    }
+
+    if (i == masknext) // masks are not shown themselves
+    {
+      if (pTrack->maskCount == MASK_ALL_TRACKS) MergeTrack(pTrack, pDisplayPixels, true, startpos, endpos);
+      else if (groupstart < masknext)
+      {
+        MergeTrack(pTrack, pGroupPixels, true, startpos, endpos);
+        MergeGroup(pTrack->draw.orPixelValues, startpos, endpos);
+      }
+      continue;
+    }
+
+    byte *pdisplay = ((i >= groupstart) ? pGroupPixels : pDisplayPixels);
+
+    if (pTrack->sparse) MergeSparseTrack(pTrack, pdisplay, startpos, endpos); // only need to merge the lit pixels
+    else MergeTrack(pTrack, pdisplay, false, startpos, endpos);
+  }
+}
+
 bool PixelNutEngine::updateEffects(void)
 {
-  bool doshow = (timePrevUpdate == 0);
+  JOURNAL(JOURNAL_UPDATE);
+
+  if (!syncMode)
+  {
+    if (loopPlaying) return LoopPlay(pixelNutSupport.getMsecs());
+    return UpdateAtTime(pixelNutSupport.getMsecs());
+  }
+
+  uint32_t msecs = pixelNutSupport.getMsecs();
+  if ((int32_t)(msecs - syncEpoch) < 0) return false; // shared time hasn't started yet
+  uint32_t time = msecs - syncEpoch;
+
+  bool doshow = false;
+
+  // step through everything that has become due in time order, so that the random
+  // values are used in the same order no matter how often this is called
+  while (true)
+  {
+    uint32_t next = NextEventTime(time);
+
+    while ((numSyncTrigs > 0) && (syncTrigs[0].msecs <= next))
+    {
+      short force = syncTrigs[0].force;
+
+      --numSyncTrigs;
+      for (int i = 0; i < numSyncTrigs; ++i) syncTrigs[i] = syncTrigs[i+1];
+
+      timeSync = next;
+      TriggerExtern(force);
+    }
+
+    if (UpdateAtTime(next)) doshow = true;
+    if (next >= time) break;
+  }
+
+  return doshow;
+}
+
+bool PixelNutEngine::seek(uint32_t msecs)
+{
+  JOURNAL(JOURNAL_SEEK, msecs);
+  if (syncMode) return false;
+
+  LoopReset(); // cached frames are no longer current
 
   uint32_t time = pixelNutSupport.getMsecs();
+  uint32_t timeEnd = time + msecs;
+
+  DBGOUT((F("Seek: msecs=%lu"), msecs));
+
+  // do any automatic triggers that would have happened before then, once each
+  timePrevUpdate = timeEnd;
+  CheckAutoTrigger(false);
+
+  // then move each track ahead by the number of redraws it would have done; since the clock
+  // hasn't actually moved, all of the timing is then shifted back by the time skipped
+  PluginTrack *pTrack = pluginTracks;
+  for (int i = 0; i <= indexTrackStack; ++i, ++pTrack)
+  {
+    if (i > indexTrackEnable) break; // at top of active layers now
+
+    if (!(pluginLayers[pTrack->layer].pPlugin->gettype() & PLUGIN_TYPE_REDRAW)) continue;
+    if (!pluginLayers[pTrack->layer].trigActive) continue;
+
+    if (pTrack->msTimeRedraw > timeEnd) // no redraw until after then
+    {
+      pTrack->msTimeRedraw -= msecs;
+      continue;
+    }
+
+    uint32_t steps;
+    if (pTrack->beatSteps && beatUsecs)
+    {
+      steps = (((uint64_t)(timeEnd - pTrack->msTimeRedraw) * 1000 * pTrack->beatSteps) / beatUsecs) + 1;
+      pTrack->msTimeRedraw = BeatTime(timeEnd, pTrack->beatSteps, 1) - msecs;
+    }
+    else
+    {
+      short addtime = pTrack->draw.msecsDelay + delayOffset;
+      if (addtime <= 0) addtime = 1; // must advance at least by 1 each time
+
+      steps = ((timeEnd - pTrack->msTimeRedraw) / addtime) + 1;
+      pTrack->msTimeRedraw += (steps * addtime) - msecs;
+    }
+
+    DBGOUT((F("Seek: track=%d steps=%lu"), i, steps));
+
+    UpdateColorVals(pTrack);
+
+    pDrawPixels = NULL; // prevent drawing by predraw effects
+
+    int endlayer = ((i < indexTrackStack) ? pluginTracks[i+1].layer : (indexLayerStack+1));
+    for (int j = pTrack->layer+1; j < endlayer; ++j)
+      if (pluginLayers[j].trigActive &&
+          !(pluginLayers[j].pPlugin->gettype() & (PLUGIN_TYPE_REDRAW | PLUGIN_TYPE_POSTDRAW)))
+          {
+            MEM_CHARGE(j);
+            pluginLayers[j].pPlugin->advance(this, &pTrack->draw, steps);
+          }
+
+    if (pTrack->sparse) pDrawSparse = (PixelNutSupport::SparsePixels*)pTrack->pRedrawBuff;
+    else pDrawPixels = pTrack->pRedrawBuff;
+    #if PIXELNUT_PLANAR
+    drawPlaneLen = pTrack->segCount;
+    #endif
+    MEM_CHARGE(pTrack->layer);
+    pluginLayers[pTrack->layer].pPlugin->advance(this, &pTrack->draw, steps);
+    pDrawPixels = pDisplayPixels;
+    pDrawSparse = NULL;
+    #if PIXELNUT_PLANAR
+    drawPlaneLen = 0;
+    #endif
+  }
+
+  for (int i = 0; i <= indexLayerStack; ++i)
+    if (pluginLayers[i].trigTimeMsecs > 0) // 0 is not set, 1 is already past due
+      pluginLayers[i].trigTimeMsecs = ((pluginLayers[i].trigTimeMsecs > (msecs+1)) ?
+                                       (pluginLayers[i].trigTimeMsecs - msecs) : 1);
+
+  beatMsecs -= msecs; // the beats have moved ahead with everything else
+
+  timePrevUpdate = 0; // forces the new position to be displayed on the next update
+  return true;
+}
+
+// internal: returns the earliest time up to 'time' that something is due
+uint32_t PixelNutEngine::NextEventTime(uint32_t time)
+{
+  uint32_t next = time;
+
+  if ((numSyncTrigs > 0) && (syncTrigs[0].msecs < next))
+    next = syncTrigs[0].msecs;
+
+  for (int i = 0; (i <= indexTrackStack) && (i <= indexTrackEnable); ++i)
+  {
+    PluginTrack *pTrack = &pluginTracks[i];
+    if ((pluginLayers[pTrack->layer].pPlugin->gettype() & PLUGIN_TYPE_REDRAW) &&
+         pluginLayers[pTrack->layer].trigActive && (pTrack->msTimeRedraw < next))
+      next = pTrack->msTimeRedraw;
+  }
+
+  for (int i = 0; i <= indexLayerStack; ++i)
+  {
+    PluginLayer *pLayer = &pluginLayers[i];
+    if (pLayer->track > indexTrackEnable) break;
+
+    if (pLayer->trigActive && pLayer->trigCount &&
+        (pLayer->trigTimeMsecs > 0) && (pLayer->trigTimeMsecs < next))
+      next = pLayer->trigTimeMsecs;
+  }
+
+  // anything already past due is done now
+  return ((next < timePrevUpdate) ? timePrevUpdate : next);
+}
+
+// internal: returns the time used for all timing, which in sync mode is the shared time
+// of the current update or timed trigger, and so is the same on all of the controllers
+uint32_t PixelNutEngine::GetTime(void)
+{
+  return (syncMode ? timeSync : pixelNutSupport.getMsecs());
+}
+
+uint32_t PixelNutEngine::getSyncTime(void)
+{
+  uint32_t msecs = pixelNutSupport.getMsecs();
+  if (!syncMode) return msecs;
+  if ((int32_t)(msecs - syncEpoch) < 0) return 0;
+  return (msecs - syncEpoch);
+}
+
+void PixelNutEngine::setTempo(uint16_t bpm, uint32_t msecs)
+{
+  DBGOUT((F("Tempo: bpm=%u msecs=%lu"), bpm, msecs));
+  JOURNAL(JOURNAL_TEMPO, bpm, msecs);
+
+  beatsPerMin = bpm;
+  beatUsecs = (bpm ? (60000000UL / bpm) : 0);
+  beatMsecs = msecs;
+  if (!beatUsecs) return; // everything continues with its current timing
+
+  LoopReset(); // frames are now timed differently
+
+  // move whatever is waiting for the next step onto the new beats
+  uint32_t time = GetTime();
+
+  for (int i = 0; i <= indexLayerStack; ++i)
+  {
+    PluginLayer *pLayer = &pluginLayers[i];
+    if (pLayer->trigBeatDivs && (pLayer->trigTimeMsecs > time))
+      pLayer->trigTimeMsecs = BeatTime(pLayer->trigTimeMsecs-1, pLayer->trigBeatDivs, 1);
+  }
+
+  for (int i = 0; i <= indexTrackStack; ++i)
+  {
+    PluginTrack *pTrack = &pluginTracks[i];
+    if (pTrack->beatSteps && (pTrack->msTimeRedraw > time))
+      pTrack->msTimeRedraw = BeatTime(time, pTrack->beatSteps, 1);
+  }
+}
+
+void PixelNutEngine::setSyncMode(bool enable, uint32_t epoch_msecs, uint32_t seed)
+{
+  DBGOUT((F("SyncMode: %s epoch=%lu seed=%lu"), (enable ? "on" : "off"), epoch_msecs, seed));
+  JOURNAL(JOURNAL_SYNCMODE, enable, epoch_msecs, seed);
+
+  syncMode = enable;
+  syncEpoch = epoch_msecs;
+  timeSync = 0; // the next pattern starts at the epoch
+  timePrevUpdate = 0;
+  numSyncTrigs = 0;
+
+  if (enable) pixelNutSupport.setRandomSeed(seed);
+  else if (pJournal == NULL) pixelNutSupport.setRandomSeed(0); // else keep them reproducible
+}
+
+void PixelNutEngine::setJournal(PixelNutJournal *pjournal, uint32_t seed)
+{
+  pJournal = pjournal;
+
+  if ((pjournal != NULL) && (pixelNutSupport.getRandomSeed() == 0))
+    pixelNutSupport.setRandomSeed(seed ? seed : 1);
+}
+
+// internal: records the settings that the next pattern starts with, for replaying it
+void PixelNutEngine::JournalState(void)
+{
+  int32_t vals[JOURNAL_STATE_VALUES] = // in the order described in PixelNutJournal.h
+  {
+    (int32_t)pixelNutSupport.getRandomSeed(), syncMode, (int32_t)syncEpoch, (int32_t)timeSync,
+    loopMaxFrames, pcentBright, delayOffset, externPropMode,
+    externDegreeHue, externPcentWhite, externPcentCount, curForce, numSyncTrigs
+  };
+  for (int i = 0; i < numSyncTrigs; ++i)
+  {
+    vals[13 + (i*2)] = syncTrigs[i].msecs;
+    vals[14 + (i*2)] = syncTrigs[i].force;
+  }
+  vals[13 + (2 * MAX_SYNC_TRIGGERS)] = beatsPerMin;
+  vals[14 + (2 * MAX_SYNC_TRIGGERS)] = (int32_t)beatMsecs;
+  vals[JOURNAL_STATE_VALUES-1] = numPixels;
+  pJournal->recordState(vals);
+}
+
+bool PixelNutEngine::triggerForceAt(short force, uint32_t msecs)
+{
+  JOURNAL(JOURNAL_FORCEAT, force, msecs);
+
+  if (!syncMode)
+  {
+    TriggerExtern(force);
+    return true;
+  }
+
+  if (numSyncTrigs >= MAX_SYNC_TRIGGERS) return false;
+
+  // keep them ordered by time, with the same times in the order received
+  int i = numSyncTrigs++;
+  for (; (i > 0) && (syncTrigs[i-1].msecs > msecs); --i)
+    syncTrigs[i] = syncTrigs[i-1];
+
+  syncTrigs[i].msecs = msecs;
+  syncTrigs[i].force = force;
+  return true;
+}
+
+// internal: does the actual updating for updateEffects() at the given time
+bool PixelNutEngine::UpdateAtTime(uint32_t time)
+{
+  bool doshow = (timePrevUpdate == 0);
+
   bool rollover = (timePrevUpdate > time);
   timePrevUpdate = time;
+  timeSync = time;
 
   CheckAutoTrigger(rollover);
 
@@ -680,127 +2113,92 @@ bool PixelNutEngine::updateEffects(void)
 
     //DBGOUT((F("redraw buffer: track=%d msecs=%lu"), i, pTrack->msTimeRedraw));
 
-    short pixCount = 0;
-    short degreeHue = 0;
-    byte pcentWhite = 0;
-
-    // prevent predraw effect from overwriting properties if in extern mode
-    if (externPropMode)
-    {
-      pixCount = pTrack->draw.pixCount;
-      degreeHue = pTrack->draw.degreeHue;
-      pcentWhite = pTrack->draw.pcentWhite;
-    }
+    UpdateColorVals(pTrack); // apply any external changes before drawing
 
     pDrawPixels = NULL; // prevent drawing by predraw effects
 
-    // call all of the predraw effects associated with this track
-    for (int j = 0; j <= indexLayerStack; ++j)
-      if ((pluginLayers[j].track == i) && pluginLayers[j].trigActive &&
-          !(pluginLayers[j].pPlugin->gettype() & PLUGIN_TYPE_REDRAW))
+    // call all of the predraw effects associated with this track, which are the layers
+    // following its drawing effect up to the drawing effect of the next track, unless the
+    // only one is stepped together with the drawing effect (once it has been triggered)
+    int endlayer = ((i < indexTrackStack) ? pluginTracks[i+1].layer : (indexLayerStack+1));
+    PluginLayer *pFused = NULL;
+    if ((pTrack->fusedStep != NULL) && ((pTrack->layer+1) < endlayer) &&
+        pluginLayers[pTrack->layer+1].trigActive)
+      pFused = &pluginLayers[pTrack->layer+1];
+
+    else for (int j = pTrack->layer+1; j < endlayer; ++j)
+      if (pluginLayers[j].trigActive &&
+          !(pluginLayers[j].pPlugin->gettype() & (PLUGIN_TYPE_REDRAW | PLUGIN_TYPE_POSTDRAW)))
+          {
+            MEM_CHARGE(j);
+            PROFILE(PROFILE_STEP, pluginLayers[j].plugin, pTrack->draw.pixLen, true);
             pluginLayers[j].pPlugin->nextstep(this, &pTrack->draw);
-
-    if (externPropMode) RestorePropVals(pTrack, pixCount, degreeHue, pcentWhite);
+            PROFILE(PROFILE_STEP, pluginLayers[j].plugin, pTrack->draw.pixLen, false);
+          }
 
     // now the main drawing effect is executed for this track
-    pDrawPixels = pTrack->pRedrawBuff; // switch to drawing buffer
-    pluginLayers[pTrack->layer].pPlugin->nextstep(this, &pTrack->draw);
+    if (pTrack->sparse) pDrawSparse = (PixelNutSupport::SparsePixels*)pTrack->pRedrawBuff;
+    else pDrawPixels = pTrack->pRedrawBuff; // switch to drawing buffer
+    #if PIXELNUT_PLANAR
+    drawPlaneLen = pTrack->segCount; // values of each pixel are in separate planes
+    #endif
+    MEM_CHARGE(pTrack->layer); // fused effects don't allocate memory when stepped
+    PROFILE(PROFILE_STEP, pluginLayers[pTrack->layer].plugin, pTrack->draw.pixLen, true);
+    if (pFused != NULL)
+      pTrack->fusedStep(this, pFused->pPlugin, pluginLayers[pTrack->layer].pPlugin, &pTrack->draw);
+    else pluginLayers[pTrack->layer].pPlugin->nextstep(this, &pTrack->draw);
+    PROFILE(PROFILE_STEP, pluginLayers[pTrack->layer].plugin, pTrack->draw.pixLen, false);
     pDrawPixels = pDisplayPixels; // restore to default (display buffer)
-
-    short addtime = pTrack->draw.msecsDelay + delayOffset;
-    //DBGOUT((F("delay=%d.%d.%d"), pTrack->draw.msecsDelay, delayOffset, addtime));
-    if (addtime <= 0) addtime = 1; // must advance at least by 1 each time
-    pTrack->msTimeRedraw = timePrevUpdate + addtime;
+    pDrawSparse = NULL;
+    #if PIXELNUT_PLANAR
+    drawPlaneLen = 0;
+    #endif
+
+    // in sync mode keep to the schedule, catching up if fallen behind it
+    uint32_t timeFrom = (syncMode ? pTrack->msTimeRedraw : timePrevUpdate);
+    if (pTrack->beatSteps && beatUsecs)
+      pTrack->msTimeRedraw = BeatTime(timeFrom, pTrack->beatSteps, 1);
+    else
+    {
+      short addtime = pTrack->draw.msecsDelay + delayOffset;
+      //DBGOUT((F("delay=%d.%d.%d"), pTrack->draw.msecsDelay, delayOffset, addtime));
+      if (addtime <= 0) addtime = 1; // must advance at least by 1 each time
+      pTrack->msTimeRedraw = timeFrom + addtime;
+    }
 
     doshow = true;
   }
 
   if (doshow)
   {
-    // merge all buffers whether just redrawn or not if anyone of them changed
-    memset(pDisplayPixels, 0, (numPixels*3)); // must clear output buffer first
-
-    pTrack = pluginTracks;
-    for (int i = 0; i <= indexTrackStack; ++i, ++pTrack) // for each plugin that can redraw
+    // merge all buffers whether just redrawn or not if anyone of them changed,
+    // a block of the output pixels at a time
+    PROFILE(PROFILE_MERGE, 0, numPixels, true);
+    uint16_t blocklen = ((PIXELNUT_MERGE_BLOCK > 0) ? PIXELNUT_MERGE_BLOCK : numPixels);
+    for (uint32_t pos = 0; pos < numPixels; pos += blocklen)
+      MergeBlock(pos, (((pos + blocklen) < numPixels) ? (pos + blocklen) : numPixels) - 1);
+    PROFILE(PROFILE_MERGE, 0, numPixels, false);
+
+    // then any postdraw effects alter the merged pixels, in stack order,
+    // each limited to the logical segment of the track it was added to
+    for (int i = 0; i <= indexLayerStack; ++i)
     {
-      if (i > indexTrackEnable) break; // at top of active layers now
+      PluginLayer *pLayer = &pluginLayers[i];
+      if (pLayer->track > indexTrackEnable) break; // not enabled yet
 
-      if (!(pluginLayers[pTrack->layer].pPlugin->gettype() & PLUGIN_TYPE_REDRAW))
-        continue;
-
-      short pixlast = numPixels-1;
-      short pixstart = pTrack->segOffset + pTrack->draw.pixStart;
-      //DBGOUT((F("%d PixStart: %d == %d+%d"), pTrack->draw.goUpwards, pixstart, pTrack->segOffset, pTrack->draw.pixStart));
-      if (pixstart > pixlast) pixstart -= (pixlast+1);
-
-      short pixend = pixstart + pTrack->draw.pixLen - 1;
-      //DBGOUT((F("%d PixEnd:  %d == %d+%d-1"), pTrack->draw.goUpwards, pixend, pixstart, pTrack->draw.pixLen));
-      if (pixend > pixlast) pixend -= (pixlast+1);
-
-      short pix = (pTrack->draw.goUpwards ? pixstart : pixend);
-      short x = pix * 3;
-      short y = pTrack->draw.pixStart * 3;
-
-      /*
-      byte *p = pTrack->pRedrawBuff;
-      DBGOUT((F("Input pixels:")));
-      for (int i = 0; i < numPixels; ++i)
-        DBGOUT((F("  %d.%d.%d"), *p++, *p++, *p++));
-      */
-      while(true)
+      if (pLayer->trigActive && (pLayer->pPlugin->gettype() & PLUGIN_TYPE_POSTDRAW))
       {
-        //DBGOUT((F(">> start.end=%d.%d pix=%d x=%d y=%d"), pixstart, pixend, pix, x, y));
-
-        if (pTrack->draw.orPixelValues)
-        {
-          // combine contents of buffer window with actual pixel array
-          pDisplayPixels[x+0] |= pTrack->pRedrawBuff[y+0];
-          pDisplayPixels[x+1] |= pTrack->pRedrawBuff[y+1];
-          pDisplayPixels[x+2] |= pTrack->pRedrawBuff[y+2];
-        }
-        else if ((pTrack->pRedrawBuff[y+0] != 0) ||
-                 (pTrack->pRedrawBuff[y+1] != 0) ||
-                 (pTrack->pRedrawBuff[y+2] != 0))
-        {
-          pDisplayPixels[x+0] = pTrack->pRedrawBuff[y+0];
-          pDisplayPixels[x+1] = pTrack->pRedrawBuff[y+1];
-          pDisplayPixels[x+2] = pTrack->pRedrawBuff[y+2];
-        }
-
-        if (pTrack->draw.goUpwards)
-        {
-          if (pix == pixend) break;
-
-          if (pix >= pixlast) // wrap around to start of strip
-          {
-            pix = x = 0;
-          }
-          else
-          {
-            ++pix;
-            x += 3;
-          }
-        }
-        else // going backwards
-        {
-          if (pix == pixstart) break;
-  
-          if (pix <= 0) // wrap around to end of strip
-          {
-            pix = pixlast;
-            x = (pixlast * 3);
-          }
-          else
-          {
-            --pix;
-            x -= 3;
-          }
-        }
-
-        if (y >= (pixlast*3)) y = 0;
-        else y += 3;
+        pTrack = &pluginTracks[pLayer->track];
+        pDrawPixels = pDisplayPixels + (pTrack->segOffset * PIXEL_CHANNELS);
+        MEM_CHARGE(i);
+        PROFILE(PROFILE_STEP, pLayer->plugin, pTrack->draw.pixLen, true);
+        pLayer->pPlugin->nextstep(this, &pTrack->draw);
+        PROFILE(PROFILE_STEP, pLayer->plugin, pTrack->draw.pixLen, false);
       }
     }
+    pDrawPixels = pDisplayPixels; // restore to default (display buffer)
+
+    if ((loopMaxFrames > 0) && !syncMode) LoopRecord(time);
 
     /*
     byte *p = pDisplayPixels;
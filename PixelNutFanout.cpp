@@ -0,0 +1,153 @@
+// PixelNut Fixture Fanout Class Implementation
+/*
+    Copyright (c) 2015-2024, Greg de Valois
+    Software License Agreement (BSD License)
+    See license.txt for the terms of this license.
+*/
+
+#include <PixelNutLib.h>
+
+#define DEBUG_OUTPUT 0 // 1 to debug this file
+#if DEBUG_OUTPUT
+#define DBG(x) x
+#define DBGOUT(x) pixelNutSupport.msgFormat x
+#else
+#define DBG(x)
+#define DBGOUT(x)
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Internal helper routines
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// mixes the value of one color with the next and previous ones, clipped to a byte
+static inline byte MixValue(const int16_t *pcoefs, byte same, byte next, byte prev)
+{
+  int32_t val = ((int32_t)pcoefs[0] * same) + ((int32_t)pcoefs[1] * next) + ((int32_t)pcoefs[2] * prev);
+  if (val <= 0) return 0;
+  val /= FANOUT_COEF_SCALE;
+  return ((val > MAX_BYTE_VALUE) ? MAX_BYTE_VALUE : val);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Public interface routines
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PixelNutFanout::PixelNutFanout(uint16_t num_pixels, PixelValOrder *pix_order, uint16_t max_delay)
+{
+  pPixOrder = pix_order;
+  numPixels = num_pixels;
+  numFrames = 0;
+
+  if (max_delay > 0)
+  {
+    pFrames = (byte*)malloc((uint32_t)(max_delay+1) * num_pixels * PIXEL_CHANNELS);
+    if (pFrames != NULL)
+    {
+      numFrames = (uint32_t)max_delay+1; // won't fit 16 bits if max_delay is 65535
+      reset();
+    }
+    DBG( else DBGOUT((F("!!! Memory alloc for %d frames failed !!!"), (max_delay+1))); )
+  }
+}
+
+PixelNutFanout::~PixelNutFanout()
+{
+  if (pFrames != NULL) free(pFrames);
+}
+
+void PixelNutFanout::reset(void)
+{
+  if (pFrames != NULL)
+  {
+    memset(pFrames, 0, ((uint32_t)numFrames * numPixels * PIXEL_CHANNELS));
+    newestFrame = 0;
+    pNewest = pFrames;
+  }
+}
+
+bool PixelNutFanout::makeInstance(Instance *pinst, uint16_t delay, bool reverse,
+                                  short hue_degree, byte bright_percent)
+{
+  if (delay >= ((numFrames > 0) ? numFrames : 1)) return false;
+
+  if (bright_percent > MAX_PERCENTAGE) bright_percent = MAX_PERCENTAGE;
+  hue_degree %= (MAX_DEGREES_HUE+1);
+
+  pinst->delay = delay;
+  pinst->reverse = reverse;
+  pinst->adjust = ((hue_degree != 0) || (bright_percent < MAX_PERCENTAGE));
+
+  // rotation around the gray axis: with 120 degrees the red values become the green ones
+  float scale = ((float)bright_percent * FANOUT_COEF_SCALE) / MAX_PERCENTAGE;
+  float angle = ((float)hue_degree * RADIANS_PER_WAVE) / (MAX_DEGREES_HUE+1);
+  float cosval = cos(angle);
+  float sinval = sin(angle) / sqrt(3.0);
+
+  pinst->coefs[0] = round(scale * ((1.0 + (2.0 * cosval)) / 3.0));
+  pinst->coefs[1] = round(scale * (((1.0 - cosval) / 3.0) - sinval));
+  pinst->coefs[2] = round(scale * (((1.0 - cosval) / 3.0) + sinval));
+  #if (PIXEL_CHANNELS == 4)
+  pinst->white = round(scale);
+  #endif
+
+  DBGOUT((F("Fanout: delay=%d reverse=%d coefs=%d,%d,%d"), delay, reverse,
+          pinst->coefs[0], pinst->coefs[1], pinst->coefs[2]));
+  return true;
+}
+
+void PixelNutFanout::addFrame(const byte *pframe)
+{
+  if (pFrames == NULL) pNewest = pframe;
+  else
+  {
+    if (++newestFrame >= numFrames) newestFrame = 0;
+    byte *p = pFrames + ((uint32_t)newestFrame * numPixels * PIXEL_CHANNELS);
+    memcpy(p, pframe, (numPixels * PIXEL_CHANNELS));
+    pNewest = p;
+  }
+}
+
+const byte *PixelNutFanout::getFrame(uint16_t delay)
+{
+  if ((pFrames == NULL) || (delay == 0)) return pNewest;
+
+  int index = newestFrame - (int)(delay % numFrames);
+  if (index < 0) index += numFrames;
+  return (pFrames + ((uint32_t)index * numPixels * PIXEL_CHANNELS));
+}
+
+void PixelNutFanout::makeFrame(const Instance *pinst, byte *pout)
+{
+  const byte *pframe = getFrame(pinst->delay);
+  if (pframe == NULL) return;
+
+  if (!pinst->adjust && !pinst->reverse)
+  {
+    memcpy(pout, pframe, (numPixels * PIXEL_CHANNELS));
+    return;
+  }
+
+  // with the pixels reversed the input is read backwards, and the output always forwards
+  int step = (pinst->reverse ? -PIXEL_CHANNELS : PIXEL_CHANNELS);
+  const byte *pin = (pinst->reverse ? (pframe + ((numPixels-1) * PIXEL_CHANNELS)) : pframe);
+
+  if (!pinst->adjust)
+  {
+    for (int i = 0; i < numPixels; ++i, pin += step, pout += PIXEL_CHANNELS)
+      memcpy(pout, pin, PIXEL_CHANNELS);
+    return;
+  }
+
+  byte ir = pPixOrder->r, ig = pPixOrder->g, ib = pPixOrder->b;
+  for (int i = 0; i < numPixels; ++i, pin += step, pout += PIXEL_CHANNELS)
+  {
+    byte r = pin[ir], g = pin[ig], b = pin[ib];
+    pout[ir] = MixValue(pinst->coefs, r, g, b);
+    pout[ig] = MixValue(pinst->coefs, g, b, r);
+    pout[ib] = MixValue(pinst->coefs, b, r, g);
+    #if (PIXEL_CHANNELS == 4)
+    pout[pPixOrder->w] = ((uint16_t)pin[pPixOrder->w] * pinst->white) / FANOUT_COEF_SCALE;
+    #endif
+  }
+}
@@ -0,0 +1,411 @@
+// PixelNut Input Journal Class Implementation
+/*
+    Copyright (c) 2015-2024, Greg de Valois
+    Software License Agreement (BSD License)
+    See license.txt for the terms of this license.
+*/
+
+#include <PixelNutLib.h>
+
+#define DEBUG_OUTPUT 0 // 1 to debug this file
+#if DEBUG_OUTPUT
+#define DBG(x) x
+#define DBGOUT(x) pixelNutSupport.msgFormat x
+#else
+#define DBG(x)
+#define DBGOUT(x)
+#endif
+
+#define MAX_VALUE_BYTES           5       // max bytes in a variable length 32-bit value
+#define UPDATE_BIT                0x80    // set in first byte of a record for an update
+
+// number of values after the time for each type of record (commands have a string instead)
+static const byte numValues[JOURNAL_NUM_TYPES] =
+{
+  JOURNAL_STATE_VALUES,   // JOURNAL_CHECKPOINT
+  0,                      // JOURNAL_UPDATE
+  0,                      // JOURNAL_COMMAND
+  0,                      // JOURNAL_CLEAR
+  1,                      // JOURNAL_FORCE:     force
+  2,                      // JOURNAL_SEGFORCE:  segment, force
+  2,                      // JOURNAL_FORCEAT:   force, msecs
+  2,                      // JOURNAL_COLOR:     hue, white
+  1,                      // JOURNAL_COUNT:     count
+  3,                      // JOURNAL_PROPS:     hue, white, count
+  3,                      // JOURNAL_SEGCOLOR:  segment, hue, white
+  2,                      // JOURNAL_SEGCOUNT:  segment, count
+  4,                      // JOURNAL_SEGPROPS:  segment, hue, white, count
+  1,                      // JOURNAL_PROPMODE:  enable
+  1,                      // JOURNAL_BRIGHT:    percent
+  1,                      // JOURNAL_DELAY:     msecs
+  1,                      // JOURNAL_LOOPCACHE: frames
+  3,                      // JOURNAL_SYNCMODE:  enable, epoch, seed
+  1,                      // JOURNAL_SEEK:      msecs
+  JOURNAL_STATE_VALUES,   // JOURNAL_FAILED
+  1,                      // JOURNAL_RESIZE:    pixels
+  2,                      // JOURNAL_TEMPO:     bpm, msecs
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Internal helper routines
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static byte *PutValue(byte *p, uint32_t value)
+{
+  while (value >= 0x80)
+  {
+    *p++ = ((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  *p++ = value;
+  return p;
+}
+
+// reads variable length value from input, returns false if not valid
+static bool GetValue(const byte **pptr, const byte *pend, uint32_t *pvalue)
+{
+  const byte *p = *pptr;
+  uint32_t value = 0;
+
+  for (int shift = 0; shift < 32; shift += 7)
+  {
+    if (p >= pend) return false;
+    byte b = *p++;
+    value |= ((uint32_t)(b & 0x7F) << shift);
+    if (!(b & 0x80))
+    {
+      *pptr = p;
+      *pvalue = value;
+      return true;
+    }
+  }
+  return false; // too many bytes
+}
+
+static uint32_t ZigZag(int32_t value)   { return (((uint32_t)value << 1) ^ (uint32_t)(value >> 31)); }
+static int32_t UnZigZag(uint32_t value) { return ((int32_t)(value >> 1) ^ -(int32_t)(value & 1)); }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Recording routines
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PixelNutJournal::PixelNutJournal(uint32_t max_bytes)
+{
+  maxBytes = max_bytes;
+  pRecords = (byte*)malloc(max_bytes);
+}
+
+PixelNutJournal::~PixelNutJournal()
+{
+  if (pRecords != NULL) free(pRecords);
+}
+
+void PixelNutJournal::reset(void)
+{
+  firstByte = 0;
+  numBytes = 0;
+  haveState = false;
+}
+
+// internal: returns the number of bytes in the record starting at 'index'
+uint32_t PixelNutJournal::RecordLength(uint32_t index)
+{
+  byte type = pRecords[index];
+  if (type & UPDATE_BIT) return 1;
+
+  // the time, then either the values or the length of the string
+  uint32_t len = 1;
+  int count = 1 + ((type == JOURNAL_COMMAND) ? 1 : numValues[type]);
+  uint32_t value = 0;
+
+  while (count--)
+  {
+    value = 0;
+    int shift = 0;
+    byte b;
+    do
+    {
+      b = pRecords[(index + len++) % maxBytes];
+      value |= ((uint32_t)(b & 0x7F) << shift);
+      shift += 7;
+    }
+    while (b & 0x80);
+  }
+
+  if (type == JOURNAL_COMMAND) len += value; // the characters follow their count
+  return len;
+}
+
+// internal: discards the oldest records until there's room for 'count' more bytes
+void PixelNutJournal::MakeRoom(uint32_t count)
+{
+  while ((numBytes + count) > maxBytes)
+  {
+    if (haveState && (firstByte == stateByte)) haveState = false;
+
+    uint32_t len = RecordLength(firstByte);
+    firstByte = (firstByte + len) % maxBytes;
+    numBytes -= len;
+  }
+}
+
+void PixelNutJournal::PutByte(byte value)
+{
+  pRecords[(firstByte + numBytes++) % maxBytes] = value;
+}
+
+bool PixelNutJournal::record(byte type, int32_t val1, int32_t val2, int32_t val3, int32_t val4)
+{
+  if (pRecords == NULL) return false;
+
+  uint32_t time = pixelNutSupport.getMsecs();
+  uint32_t msecs = time - timePrevRecord;
+  timePrevRecord = time;
+
+  byte buff[1 + (5 * MAX_VALUE_BYTES)];
+  byte *p = buff;
+
+  if ((type == JOURNAL_UPDATE) && (msecs < UPDATE_BIT)) *p++ = (UPDATE_BIT | msecs);
+  else
+  {
+    int32_t vals[] = { val1, val2, val3, val4 };
+    *p++ = type;
+    p = PutValue(p, msecs);
+    for (int i = 0; i < numValues[type]; ++i)
+      p = PutValue(p, ZigZag(vals[i]));
+  }
+
+  if ((uint32_t)(p - buff) > maxBytes) // can never fit, so what's there can't be replayed
+  {
+    DBGOUT((F("Journal: record of %d bytes dropped"), (int)(p - buff)));
+    reset();
+    return false;
+  }
+
+  MakeRoom(p - buff);
+  for (byte *q = buff; q < p; ++q) PutByte(*q);
+  return true;
+}
+
+bool PixelNutJournal::recordState(const int32_t *pvals)
+{
+  if (pRecords == NULL) return false;
+
+  timePrevRecord = pixelNutSupport.getMsecs();
+
+  byte buff[1 + ((1 + JOURNAL_STATE_VALUES) * MAX_VALUE_BYTES)];
+  byte *p = buff;
+
+  *p++ = JOURNAL_CHECKPOINT;
+  p = PutValue(p, timePrevRecord); // the full time, not from the previous record
+  for (int i = 0; i < JOURNAL_STATE_VALUES; ++i)
+    p = PutValue(p, ZigZag(pvals[i]));
+
+  if ((uint32_t)(p - buff) > maxBytes) // can never fit, so what's there can't be replayed
+  {
+    DBGOUT((F("Journal: checkpoint of %d bytes dropped"), (int)(p - buff)));
+    reset();
+    return false;
+  }
+
+  MakeRoom(p - buff);
+  stateByte = ((firstByte + numBytes) % maxBytes);
+  haveState = true;
+  for (byte *q = buff; q < p; ++q) PutByte(*q);
+  return true;
+}
+
+void PixelNutJournal::failedState(void)
+{
+  if (haveState) pRecords[stateByte] = JOURNAL_FAILED;
+  haveState = false;
+}
+
+bool PixelNutJournal::recordCommand(const char *cmdstr)
+{
+  if (pRecords == NULL) return false;
+
+  uint32_t time = pixelNutSupport.getMsecs();
+  uint32_t msecs = time - timePrevRecord;
+  timePrevRecord = time;
+
+  byte buff[1 + (2 * MAX_VALUE_BYTES)];
+  byte *p = buff;
+  uint32_t count = strlen(cmdstr);
+
+  *p++ = JOURNAL_COMMAND;
+  p = PutValue(p, msecs);
+  p = PutValue(p, count);
+
+  if (((p - buff) + count) > maxBytes) // can never fit, so what's there can't be replayed
+  {
+    DBGOUT((F("Journal: command of %d bytes dropped"), count));
+    reset();
+    return false;
+  }
+
+  MakeRoom((p - buff) + count);
+  for (byte *q = buff; q < p; ++q) PutByte(*q);
+  for (uint32_t i = 0; i < count; ++i) PutByte(cmdstr[i]);
+  return true;
+}
+
+uint32_t PixelNutJournal::readRecords(byte *pout, uint32_t maxlen)
+{
+  if (maxlen < numBytes) return 0;
+
+  for (uint32_t i = 0; i < numBytes; ++i)
+    pout[i] = pRecords[(firstByte + i) % maxBytes];
+
+  return numBytes;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Replaying routines
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static uint32_t replayTime; // virtual clock while replaying
+static uint32_t ReplayMsecs(void) { return replayTime; }
+
+// internal: restores the settings from a checkpoint into a new engine
+void PixelNutJournal::SetState(PixelNutEngine *pengine, const int32_t *pvals)
+{
+  pengine->setSyncMode(pvals[1], pvals[2]);
+  pixelNutSupport.setRandomSeed(pvals[0]);
+  pengine->timeSync = pvals[3];
+  pengine->setLoopCache(pvals[4]);
+  pengine->setMaxBrightness(pvals[5]);
+  pengine->setDelayOffset(pvals[6]);
+  pengine->setPropertyMode(pvals[7]);
+  pengine->setProperties(pvals[8], pvals[9], pvals[10]);
+  pengine->curForce = pvals[11];
+
+  pengine->numSyncTrigs = pvals[12];
+  for (int i = 0; i < MAX_SYNC_TRIGGERS; ++i)
+  {
+    pengine->syncTrigs[i].msecs = pvals[13 + (i*2)];
+    pengine->syncTrigs[i].force = pvals[14 + (i*2)];
+  }
+
+  pengine->setTempo(pvals[13 + (2 * MAX_SYNC_TRIGGERS)], pvals[14 + (2 * MAX_SYNC_TRIGGERS)]);
+}
+
+uint32_t PixelNutJournal::replay(const byte *pdata, uint32_t len, PixelNutEngine *pengine,
+                                 void (*frame_func)(uint32_t msecs, bool changed))
+{
+  const byte *p = pdata;
+  const byte *pend = pdata + len;
+  bool started = false; // set at the first checkpoint
+  uint32_t updates = 0;
+
+  GetMsecsTime getmsecs = pixelNutSupport.getMsecs;
+  pixelNutSupport.getMsecs = ReplayMsecs;
+
+  while (p < pend)
+  {
+    byte type = *p++;
+    if (type & UPDATE_BIT)
+    {
+      if (!started) continue;
+
+      replayTime += (type & ~UPDATE_BIT);
+      bool changed = pengine->updateEffects();
+      if (frame_func != NULL) (*frame_func)(replayTime, changed);
+      ++updates;
+      continue;
+    }
+
+    uint32_t msecs;
+    if ((type >= JOURNAL_NUM_TYPES) || !GetValue(&p, pend, &msecs)) { updates = 0; break; }
+
+    if (type == JOURNAL_COMMAND)
+    {
+      uint32_t count;
+      if (!GetValue(&p, pend, &count) || (count > (uint32_t)(pend - p))) { updates = 0; break; }
+
+      if (started)
+      {
+        char *cmdstr = (char*)malloc(count + 1);
+        if (cmdstr == NULL) { updates = 0; break; }
+        memcpy(cmdstr, p, count);
+        cmdstr[count] = 0;
+
+        replayTime += msecs;
+        DBGOUT((F("Replay: %lu \"%s\""), replayTime, cmdstr));
+        pengine->execCmdStr(cmdstr);
+        free(cmdstr);
+      }
+      p += count;
+      continue;
+    }
+
+    int32_t vals[JOURNAL_STATE_VALUES];
+    bool valid = true;
+    for (int i = 0; valid && (i < numValues[type]); ++i)
+    {
+      uint32_t value;
+      valid = GetValue(&p, pend, &value);
+      vals[i] = UnZigZag(value);
+    }
+    if (!valid) { updates = 0; break; }
+
+    if (type == JOURNAL_FAILED) // only the time is used
+    {
+      replayTime = msecs;
+      continue;
+    }
+
+    if (type == JOURNAL_CHECKPOINT)
+    {
+      if (!started && (vals[JOURNAL_STATE_VALUES-1] != pengine->numPixels)) break;
+      replayTime = msecs;
+      if (!started) SetState(pengine, vals); // the rest follow from replaying the records
+      started = true;
+      continue;
+    }
+
+    if (!started) continue;
+    if (type == JOURNAL_RESIZE) break; // the new pixels belong to the application
+    replayTime += msecs;
+
+    switch (type)
+    {
+      case JOURNAL_UPDATE:
+      {
+        bool changed = pengine->updateEffects();
+        if (frame_func != NULL) (*frame_func)(replayTime, changed);
+        ++updates;
+        break;
+      }
+      case JOURNAL_CLEAR:     pengine->clearStack(); break;
+      case JOURNAL_FORCE:     pengine->triggerForce((short)vals[0]); break;
+      case JOURNAL_SEGFORCE:  pengine->triggerSegForce(vals[0], vals[1]); break;
+      case JOURNAL_FORCEAT:   pengine->triggerForceAt(vals[0], vals[1]); break;
+      case JOURNAL_COLOR:     pengine->setColorProperty(vals[0], vals[1]); break;
+      case JOURNAL_COUNT:     pengine->setCountProperty(vals[0]); break;
+      case JOURNAL_PROPS:     pengine->setProperties(vals[0], vals[1], vals[2]); break;
+      case JOURNAL_SEGCOLOR:  pengine->setSegColorProperty(vals[0], vals[1], vals[2]); break;
+      case JOURNAL_SEGCOUNT:  pengine->setSegCountProperty(vals[0], vals[1]); break;
+      case JOURNAL_SEGPROPS:  pengine->setSegProperties(vals[0], vals[1], vals[2], vals[3]); break;
+      case JOURNAL_PROPMODE:  pengine->setPropertyMode(vals[0]); break;
+      case JOURNAL_BRIGHT:    pengine->setMaxBrightness(vals[0]); break;
+      case JOURNAL_DELAY:     pengine->setDelayOffset(vals[0]); break;
+      case JOURNAL_LOOPCACHE: pengine->setLoopCache(vals[0]); break;
+      case JOURNAL_SEEK:      pengine->seek(vals[0]); break;
+      case JOURNAL_TEMPO:     pengine->setTempo(vals[0], vals[1]); break;
+      case JOURNAL_SYNCMODE:
+      {
+        // the recorded engine kept its random values seeded when sync mode was disabled
+        uint32_t state = pixelNutSupport.getRandomSeed();
+        pengine->setSyncMode(vals[0], vals[1], vals[2]);
+        if (!vals[0]) pixelNutSupport.setRandomSeed(state);
+        break;
+      }
+    }
+  }
+
+  pixelNutSupport.getMsecs = getmsecs;
+
+  DBGOUT((F("Replayed %lu updates"), updates));
+  return (started ? updates : 0);
+}
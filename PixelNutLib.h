@@ -1,3 +1,7 @@
 #include "includes/PixelNutSupport.h"   // engine support interface and standard types
 #include "includes/PixelNutPlugin.h"    // template for all plugins (abstract class)
+#include "includes/PixelNutSequence.h"  // base class for plugins written as a sequence of steps
+#include "includes/PixelNutJournal.h"   // recording and replaying the calls into the engine
 #include "includes/PixelNutEngine.h"    // main header file for pixelnut engine
+#include "includes/PixelNutCodec.h"     // encoding/decoding of recorded frames
+#include "includes/PixelNutFanout.h"    // showing output pixels on many fixtures
@@ -99,6 +99,161 @@ static void HSVtoRGB(int hue, byte sat, byte val, byte *rptr, byte *gptr, byte *
   *bptr = GammaCorrection(b * MAX_BYTE_VALUE);
 }
 
+// integer only version of the above, used for converting spans of pixels:
+// hue: 0...((MAX_DEGREES_HUE+1) * HUE_STEP_SCALE)-1
+// sat: 0...MAX_BYTE_VALUE
+// val: 0...MAX_BYTE_VALUE
+static inline byte Scale8(byte inval, byte scale) { return ((uint16_t)inval * scale + inval) >> 8; }
+
+static inline void HSVtoRGB8(uint32_t hue, byte sat, byte val, byte *rptr, byte *gptr, byte *bptr)
+{
+  uint16_t sector = hue / (60 * HUE_STEP_SCALE); // which 60 degree section
+  byte smod = ((hue % (60 * HUE_STEP_SCALE)) * MAX_BYTE_VALUE) / (60 * HUE_STEP_SCALE); // 0..255
+
+  byte p = Scale8(val, (MAX_BYTE_VALUE - sat));
+  byte q = Scale8(val, (MAX_BYTE_VALUE - Scale8(sat, smod)));
+  byte t = Scale8(val, (MAX_BYTE_VALUE - Scale8(sat, (MAX_BYTE_VALUE - smod))));
+  byte r, g, b;
+
+  switch (sector)
+  {
+    case 0:  r = val; g = t;   b = p;   break; // 0-60
+    case 1:  r = q;   g = val; b = p;   break; // 60-120
+    case 2:  r = p;   g = val; b = t;   break; // 120-180
+    case 3:  r = p;   g = q;   b = val; break; // 180-240
+    case 4:  r = t;   g = p;   b = val; break; // 240-300
+    default: r = val; g = p;   b = q;   break; // 300-359
+  }
+
+  *rptr = GammaCorrection(r);
+  *gptr = GammaCorrection(g);
+  *bptr = GammaCorrection(b);
+}
+
+// returns index of the first pixel in the list of lit pixels for a sparse track that is at
+// 'pos' or after it (the count if none are), using a binary search, since they're kept in order
+static int SparseLower(PixelNutSupport::SparsePixels *psparse, uint32_t pos)
+{
+  int first = 0, last = psparse->count;
+  while (first < last)
+  {
+    int mid = (first + last) / 2;
+    if (psparse->pixels[mid].pos < pos) first = mid+1;
+    else last = mid;
+  }
+  return first;
+}
+
+// returns index of pixel in the list of lit pixels for a sparse track, or -1 if not lit
+static int SparseFind(PixelNutSupport::SparsePixels *psparse, uint16_t pos)
+{
+  int index = SparseLower(psparse, pos);
+  if ((index < psparse->count) && (psparse->pixels[index].pos == pos)) return index;
+  return -1;
+}
+
+// makes sure there's room in the list of lit pixels for at least 'count' of them,
+// returning false if there isn't enough memory for that
+static bool SparseRoom(PixelNutSupport::SparsePixels *psparse, uint32_t count)
+{
+  if (count <= psparse->maxcount) return true;
+  if (count > MAX_WORD_VALUE) return false;
+
+  uint16_t maxcount = (psparse->maxcount ? psparse->maxcount : 8);
+  while (maxcount < count) maxcount = ((maxcount < (MAX_WORD_VALUE/2)) ? (maxcount * 2) : MAX_WORD_VALUE);
+
+  PixelNutSupport::SparsePixel *p = (PixelNutSupport::SparsePixel*)
+                  pixelNutSupport.memRealloc(psparse->pixels, ((uint32_t)maxcount * sizeof(PixelNutSupport::SparsePixel)));
+  if (p == NULL) return false;
+
+  psparse->pixels = p;
+  psparse->maxcount = maxcount;
+  return true;
+}
+
+// removes the pixels 'first'...'last'-1 from the list of lit pixels, keeping the rest in order
+static void SparseRemove(PixelNutSupport::SparsePixels *psparse, int first, int last)
+{
+  if (first >= last) return;
+  memmove(&psparse->pixels[first], &psparse->pixels[last],
+          ((psparse->count - last) * sizeof(PixelNutSupport::SparsePixel)));
+  psparse->count -= (last - first);
+}
+
+// reverses the order of the pixels 'first'...'last'-1 in the list of lit pixels
+static void SparseReverse(PixelNutSupport::SparsePixels *psparse, int first, int last)
+{
+  for (--last; first < last; ++first, --last)
+  {
+    PixelNutSupport::SparsePixel pix = psparse->pixels[first];
+    psparse->pixels[first] = psparse->pixels[last];
+    psparse->pixels[last] = pix;
+  }
+}
+
+// adds pixel to the list of lit pixels for a sparse track, or removes it if all values are 0,
+// growing the list as needed (the pixel is dropped if there isn't enough memory for that)
+static void SparseSet(PixelNutSupport::SparsePixels *psparse, uint16_t pos, byte *pvals)
+{
+  int index = SparseLower(psparse, pos);
+  bool found = ((index < psparse->count) && (psparse->pixels[index].pos == pos));
+  #if (PIXEL_CHANNELS == 4)
+  bool islit = (pvals[0] || pvals[1] || pvals[2] || pvals[3]);
+  #else
+  bool islit = (pvals[0] || pvals[1] || pvals[2]);
+  #endif
+
+  if (!found)
+  {
+    if (!islit) return; // already off
+    if (!SparseRoom(psparse, psparse->count+1)) return;
+
+    // pixels are usually drawn in order, so this is most often added at the end
+    memmove(&psparse->pixels[index+1], &psparse->pixels[index],
+            ((psparse->count - index) * sizeof(PixelNutSupport::SparsePixel)));
+    ++psparse->count;
+    psparse->pixels[index].pos = pos;
+  }
+  else if (!islit)
+  {
+    SparseRemove(psparse, index, index+1);
+    return;
+  }
+
+  memcpy(psparse->pixels[index].vals, pvals, PIXEL_CHANNELS);
+}
+
+// same as memmove() on the pixels of a sparse track: the new range is overwritten with
+// the pixels in the old range, and pixels in the old range that aren't overwritten remain
+static void SparseMove(PixelNutSupport::SparsePixels *psparse, uint16_t startpos, uint16_t endpos, uint16_t newpos)
+{
+  uint16_t newend = newpos + (endpos - startpos);
+
+  // the pixels in each range are together in the list, since it's in order
+  int oldfirst = SparseLower(psparse, startpos);
+  int oldlast  = SparseLower(psparse, endpos+1);
+  int newfirst = SparseLower(psparse, newpos);
+  int newlast  = SparseLower(psparse, newend+1);
+  int moved = oldlast - oldfirst;
+
+  // the moved pixels are first copied to the end of the list with their new positions
+  // (dropping them all if there isn't enough memory for that)
+  if (!SparseRoom(psparse, psparse->count + moved)) moved = 0;
+  for (int i = 0; i < moved; ++i)
+  {
+    PixelNutSupport::SparsePixel *ppix = &psparse->pixels[psparse->count + i];
+    *ppix = psparse->pixels[oldfirst + i];
+    ppix->pos = (ppix->pos - startpos) + newpos;
+  }
+  psparse->count += moved;
+
+  // then the pixels that are overwritten are removed, and the copies rotated into their place
+  SparseRemove(psparse, newfirst, newlast);
+  SparseReverse(psparse, newfirst, psparse->count);
+  SparseReverse(psparse, newfirst, (newfirst + moved));
+  SparseReverse(psparse, (newfirst + moved), psparse->count);
+}
+
 // empty default routine for debug output
 #if defined(ESP32)
 static void MsgFormat(const char *str, ...) {}
@@ -107,6 +262,51 @@ static void MsgFormat(const __FlashStringHelper *str, ...) {}
 #endif
 
 static PixelValOrder *pPixOrder;
+static uint32_t randomState = 0; // 0 if using random()
+
+// stores RGB values into a pixel in the output order; for RGBW pixels the white that is
+// common to all 3 values (which is what the whiteness property adds) goes into the W channel
+static inline void StorePixel(byte *ppixs, int valstep, byte r, byte g, byte b)
+{
+  #if (PIXEL_CHANNELS == 4)
+  byte w = ((r < g) ? r : g);
+  if (b < w) w = b;
+  r -= w; g -= w; b -= w;
+  ppixs[pPixOrder->w * valstep] = w;
+  #endif
+
+  ppixs[pPixOrder->r * valstep] = r;
+  ppixs[pPixOrder->g * valstep] = g;
+  ppixs[pPixOrder->b * valstep] = b;
+}
+
+// reverses the above, adding any white back into the RGB values
+static inline void LoadPixel(byte *ppixs, int valstep, byte *ptr_r, byte *ptr_g, byte *ptr_b)
+{
+  #if (PIXEL_CHANNELS == 4)
+  uint16_t w = ppixs[pPixOrder->w * valstep];
+  uint16_t r = ppixs[pPixOrder->r * valstep] + w;
+  uint16_t g = ppixs[pPixOrder->g * valstep] + w;
+  uint16_t b = ppixs[pPixOrder->b * valstep] + w;
+  *ptr_r = ((r > MAX_BYTE_VALUE) ? MAX_BYTE_VALUE : r);
+  *ptr_g = ((g > MAX_BYTE_VALUE) ? MAX_BYTE_VALUE : g);
+  *ptr_b = ((b > MAX_BYTE_VALUE) ? MAX_BYTE_VALUE : b);
+  #else
+  *ptr_r = ppixs[pPixOrder->r * valstep];
+  *ptr_g = ppixs[pPixOrder->g * valstep];
+  *ptr_b = ppixs[pPixOrder->b * valstep];
+  #endif
+}
+
+// distance between pixels, and between the values of each pixel, in the buffer being drawn:
+// with PIXELNUT_PLANAR the pixels of tracks are in planes, but the output pixels never are
+#if PIXELNUT_PLANAR
+#define PIX_STEP(e)   ((e)->drawPlaneLen ? 1 : PIXEL_CHANNELS)
+#define VAL_STEP(e)   ((e)->drawPlaneLen ? (e)->drawPlaneLen : 1)
+#else
+#define PIX_STEP(e)   PIXEL_CHANNELS
+#define VAL_STEP(e)   1
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Public interface routines
@@ -126,16 +326,43 @@ void PixelNutSupport::makeColorVals(DrawProps *pdraw)
   HSVtoRGB(pdraw->degreeHue, (MAX_PERCENTAGE - pdraw->pcentWhite), brightval, &pdraw->r, &pdraw->g, &pdraw->b);
 }
 
+bool PixelNutSupport::setPropHue(DrawProps *pdraw, uint16_t degrees)
+{
+  if (pdraw->extLocks & PixelNutEngine::ExtControlBit_DegreeHue) return false;
+  pdraw->degreeHue = degrees;
+  return true;
+}
+
+bool PixelNutSupport::setPropWhite(DrawProps *pdraw, byte percent)
+{
+  if (pdraw->extLocks & PixelNutEngine::ExtControlBit_PcentWhite) return false;
+  pdraw->pcentWhite = percent;
+  return true;
+}
+
+bool PixelNutSupport::setPropCount(DrawProps *pdraw, uint16_t count)
+{
+  if (pdraw->extLocks & PixelNutEngine::ExtControlBit_PixCount) return false;
+  pdraw->pixCount = count;
+  return true;
+}
+
 void PixelNutSupport::movePixels(PixelNutHandle handle, uint16_t startpos, uint16_t endpos, uint16_t newpos)
 {
   PixelNutEngine *pEngine = (PixelNutEngine*)handle;
   if (pEngine->pDrawPixels != NULL)
   {
-    byte *ppixs1 = (pEngine->pDrawPixels + (startpos * 3));
-    byte *ppixs2 = (pEngine->pDrawPixels + (newpos * 3));
-    int count = (endpos - startpos + 1) * 3;
-    memmove(ppixs2, ppixs1, count); 
+    int pixstep = PIX_STEP(pEngine), valstep = VAL_STEP(pEngine);
+    byte *ppixs1 = (pEngine->pDrawPixels + (startpos * pixstep));
+    byte *ppixs2 = (pEngine->pDrawPixels + (newpos * pixstep));
+    int count = (endpos - startpos + 1) * pixstep;
+
+    // each plane is moved separately (or all values at once if not planar)
+    for (int i = 0; i < (PIXEL_CHANNELS / pixstep); ++i)
+      memmove((ppixs2 + (i * valstep)), (ppixs1 + (i * valstep)), count);
   }
+  else if (pEngine->pDrawSparse != NULL)
+    SparseMove(pEngine->pDrawSparse, startpos, endpos, newpos);
 }
 
 void PixelNutSupport::clearPixels(PixelNutHandle handle, uint16_t startpos, uint16_t endpos)
@@ -143,38 +370,61 @@ void PixelNutSupport::clearPixels(PixelNutHandle handle, uint16_t startpos, uint
   PixelNutEngine *pEngine = (PixelNutEngine*)handle;
   if (pEngine->pDrawPixels != NULL)
   {
-    byte *ppixs = (pEngine->pDrawPixels + (startpos * 3));
-    int count = (endpos - startpos + 1) * 3;
-    memset(ppixs, 0, count);
+    int pixstep = PIX_STEP(pEngine), valstep = VAL_STEP(pEngine);
+    byte *ppixs = (pEngine->pDrawPixels + (startpos * pixstep));
+    int count = (endpos - startpos + 1) * pixstep;
+
+    for (int i = 0; i < (PIXEL_CHANNELS / pixstep); ++i)
+      memset((ppixs + (i * valstep)), 0, count);
+  }
+  else if (pEngine->pDrawSparse != NULL)
+  {
+    SparsePixels *psparse = pEngine->pDrawSparse;
+    SparseRemove(psparse, SparseLower(psparse, startpos), SparseLower(psparse, endpos+1));
   }
 }
 
 void PixelNutSupport::getPixel(PixelNutHandle handle, uint16_t pos, byte *ptr_r, byte *ptr_g, byte *ptr_b)
 {
   PixelNutEngine *pEngine = (PixelNutEngine*)handle;
+  byte *ppixs = NULL;
+  int valstep = 1;
+
   if (pEngine->pDrawPixels != NULL)
   {
-    byte *ppixs = (pEngine->pDrawPixels + (pos * 3));
-    *ptr_r = ppixs[pPixOrder->r];
-    *ptr_g = ppixs[pPixOrder->g];
-    *ptr_b = ppixs[pPixOrder->b];
-   }
+    ppixs = (pEngine->pDrawPixels + (pos * PIX_STEP(pEngine)));
+    valstep = VAL_STEP(pEngine);
+  }
+
+  else if (pEngine->pDrawSparse != NULL)
+  {
+    int index = SparseFind(pEngine->pDrawSparse, pos);
+    if (index < 0) *ptr_r = *ptr_g = *ptr_b = 0; // pixel is off
+    else ppixs = pEngine->pDrawSparse->pixels[index].vals;
+  }
+
+  if (ppixs != NULL) LoadPixel(ppixs, valstep, ptr_r, ptr_g, ptr_b);
 }
 
 void PixelNutSupport::setPixel(PixelNutHandle handle, uint16_t pos, byte r, byte g, byte b, float scale)
 {
   PixelNutEngine *pEngine = (PixelNutEngine*)handle;
+  byte vals[PIXEL_CHANNELS];
+  byte *ppixs = vals;
+  int valstep = 1;
+
   if (pEngine->pDrawPixels != NULL)
   {
-    byte *ppixs = (pEngine->pDrawPixels + (pos * 3));
+    ppixs = (pEngine->pDrawPixels + (pos * PIX_STEP(pEngine)));
+    valstep = VAL_STEP(pEngine);
+  }
+  else if (pEngine->pDrawSparse == NULL) return;
 
-    byte brightval = (scale * pEngine->getMaxBrightness() * MAX_BYTE_VALUE) / MAX_PERCENTAGE;
-    float factor = ((float)GammaCorrection(brightval) / MAX_BYTE_VALUE);
+  float factor = ((float)GammaCorrection(scaleBright(handle, scale)) / MAX_BYTE_VALUE);
 
-    ppixs[pPixOrder->r] = r * factor;
-    ppixs[pPixOrder->g] = g * factor;
-    ppixs[pPixOrder->b] = b * factor;
-  }
+  StorePixel(ppixs, valstep, (r * factor), (g * factor), (b * factor));
+
+  if (ppixs == vals) SparseSet(pEngine->pDrawSparse, pos, vals);
 }
 
 void PixelNutSupport::setPixel(PixelNutHandle handle, uint16_t pos, float scale)
@@ -182,14 +432,305 @@ void PixelNutSupport::setPixel(PixelNutHandle handle, uint16_t pos, float scale)
   PixelNutEngine *pEngine = (PixelNutEngine*)handle;
   if (pEngine->pDrawPixels != NULL)
   {
-    byte *ppixs = (pEngine->pDrawPixels + (pos * 3));
+    byte *ppixs = (pEngine->pDrawPixels + (pos * PIX_STEP(pEngine)));
+    int valstep = VAL_STEP(pEngine);
+
+    ppixs[pPixOrder->r * valstep] *= scale;
+    ppixs[pPixOrder->g * valstep] *= scale;
+    ppixs[pPixOrder->b * valstep] *= scale;
+    #if (PIXEL_CHANNELS == 4)
+    ppixs[pPixOrder->w * valstep] *= scale;
+    #endif
+  }
+  else if (pEngine->pDrawSparse != NULL)
+  {
+    int index = SparseFind(pEngine->pDrawSparse, pos);
+    if (index >= 0)
+    {
+      byte vals[PIXEL_CHANNELS];
+      vals[0] = pEngine->pDrawSparse->pixels[index].vals[0] * scale;
+      vals[1] = pEngine->pDrawSparse->pixels[index].vals[1] * scale;
+      vals[2] = pEngine->pDrawSparse->pixels[index].vals[2] * scale;
+      #if (PIXEL_CHANNELS == 4)
+      vals[3] = pEngine->pDrawSparse->pixels[index].vals[3] * scale;
+      #endif
+      SparseSet(pEngine->pDrawSparse, pos, vals);
+    }
+  }
+}
+
+byte PixelNutSupport::scaleBright(PixelNutHandle handle, float scale)
+{
+  return (scale * ((PixelNutEngine*)handle)->getMaxBrightness() * MAX_BYTE_VALUE) / MAX_PERCENTAGE;
+}
+
+void PixelNutSupport::fillPixels(PixelNutHandle handle, uint16_t startpos, uint16_t endpos,
+                                 byte r, byte g, byte b, byte bright)
+{
+  PixelNutEngine *pEngine = (PixelNutEngine*)handle;
+  if (pEngine->pDrawPixels != NULL)
+  {
+    int pixstep = PIX_STEP(pEngine), valstep = VAL_STEP(pEngine);
+    byte *ppixs = (pEngine->pDrawPixels + (startpos * pixstep));
+    int count = (endpos - startpos + 1);
+
+    // the values are made the same way as setPixel(), but only once
+    float factor = ((float)GammaCorrection(bright) / MAX_BYTE_VALUE);
+    byte vals[PIXEL_CHANNELS];
+    StorePixel(vals, 1, (r * factor), (g * factor), (b * factor));
 
-    ppixs[pPixOrder->r] *= scale;
-    ppixs[pPixOrder->g] *= scale;
-    ppixs[pPixOrder->b] *= scale;
+    if (pixstep == 1) // each plane is set separately
+    {
+      for (int i = 0; i < PIXEL_CHANNELS; ++i)
+        memset((ppixs + (i * valstep)), vals[i], count);
+    }
+    else for (int i = 0; i < count; ++i, ppixs += pixstep)
+      memcpy(ppixs, vals, PIXEL_CHANNELS);
   }
 }
 
+void PixelNutSupport::setPixelsHSV(PixelNutHandle handle, uint16_t startpos, uint16_t endpos,
+                                   const uint16_t *phues, const byte *psats, const byte *pvals)
+{
+  PixelNutEngine *pEngine = (PixelNutEngine*)handle;
+  if (pEngine->pDrawPixels != NULL)
+  {
+    int pixstep = PIX_STEP(pEngine), valstep = VAL_STEP(pEngine);
+    byte *ppixs = (pEngine->pDrawPixels + (startpos * pixstep));
+    int count = (endpos - startpos + 1);
+
+    // max brightness is applied the same way as setPixel(), but only calculated once
+    byte brightval = ((uint16_t)pEngine->getMaxBrightness() * MAX_BYTE_VALUE) / MAX_PERCENTAGE;
+    byte factor = GammaCorrection(brightval);
+
+    for (int i = 0; i < count; ++i, ppixs += pixstep)
+    {
+      uint32_t hue = (uint32_t)clipValue(phues[i], 0, MAX_DEGREES_HUE) * HUE_STEP_SCALE;
+      byte sat = ((uint16_t)clipValue(psats[i], 0, MAX_PERCENTAGE) * MAX_BYTE_VALUE) / MAX_PERCENTAGE;
+      byte r, g, b;
+
+      HSVtoRGB8(hue, sat, pvals[i], &r, &g, &b);
+
+      StorePixel(ppixs, valstep, Scale8(r, factor), Scale8(g, factor), Scale8(b, factor));
+    }
+  }
+}
+
+void PixelNutSupport::setPixelsHue(PixelNutHandle handle, uint16_t startpos, uint16_t endpos,
+                                   uint32_t hue, int32_t step, byte sat, byte val)
+{
+  PixelNutEngine *pEngine = (PixelNutEngine*)handle;
+  if (pEngine->pDrawPixels != NULL)
+  {
+    int pixstep = PIX_STEP(pEngine), valstep = VAL_STEP(pEngine);
+    byte *ppixs = (pEngine->pDrawPixels + (startpos * pixstep));
+    int count = (endpos - startpos + 1);
+
+    byte brightval = ((uint16_t)pEngine->getMaxBrightness() * MAX_BYTE_VALUE) / MAX_PERCENTAGE;
+    byte factor = GammaCorrection(brightval);
+
+    int32_t maxhue = (MAX_DEGREES_HUE+1) * HUE_STEP_SCALE;
+    sat = ((uint16_t)clipValue(sat, 0, MAX_PERCENTAGE) * MAX_BYTE_VALUE) / MAX_PERCENTAGE;
+
+    // keep both the hue and step within a single circle so only one wrap is needed per pixel
+    step %= maxhue;
+    if (step < 0) step += maxhue;
+    int32_t curhue = (hue % maxhue);
+
+    for (int i = 0; i < count; ++i, ppixs += pixstep)
+    {
+      byte r, g, b;
+      HSVtoRGB8(curhue, sat, val, &r, &g, &b);
+
+      StorePixel(ppixs, valstep, Scale8(r, factor), Scale8(g, factor), Scale8(b, factor));
+
+      curhue += step;
+      if (curhue >= maxhue) curhue -= maxhue;
+    }
+  }
+}
+
+void PixelNutSupport::scalePixels(PixelNutHandle handle, uint16_t startpos, uint16_t endpos, byte scale)
+{
+  PixelNutEngine *pEngine = (PixelNutEngine*)handle;
+  if (pEngine->pDrawPixels != NULL)
+  {
+    int pixstep = PIX_STEP(pEngine), valstep = VAL_STEP(pEngine);
+    int count = (endpos - startpos + 1) * pixstep;
+
+    // all color values are treated the same, so no need to handle individual pixels
+    for (int c = 0; c < (PIXEL_CHANNELS / pixstep); ++c)
+    {
+      byte *ppixs = (pEngine->pDrawPixels + (startpos * pixstep) + (c * valstep));
+      for (int i = 0; i < count; ++i)
+        ppixs[i] = ((uint16_t)ppixs[i] * scale) >> 8;
+    }
+  }
+  else if (pEngine->pDrawSparse != NULL)
+  {
+    SparsePixels *psparse = pEngine->pDrawSparse;
+    int lit = SparseLower(psparse, startpos);
+    int last = SparseLower(psparse, endpos+1);
+    for (int i = lit; i < last; ++i)
+    {
+      SparsePixel *ppix = &psparse->pixels[lit];
+      *ppix = psparse->pixels[i];
+
+      ppix->vals[0] = ((uint16_t)ppix->vals[0] * scale) >> 8;
+      ppix->vals[1] = ((uint16_t)ppix->vals[1] * scale) >> 8;
+      ppix->vals[2] = ((uint16_t)ppix->vals[2] * scale) >> 8;
+      #if (PIXEL_CHANNELS == 4)
+      ppix->vals[3] = ((uint16_t)ppix->vals[3] * scale) >> 8;
+      if (ppix->vals[3]) { ++lit; continue; }
+      #endif
+
+      // pixels that have been turned off are removed
+      if (ppix->vals[0] || ppix->vals[1] || ppix->vals[2]) ++lit;
+    }
+    SparseRemove(psparse, lit, last);
+  }
+}
+
+void PixelNutSupport::blurPixels(PixelNutHandle handle, uint16_t startpos, uint16_t endpos, byte radius)
+{
+  PixelNutEngine *pEngine = (PixelNutEngine*)handle;
+  if ((pEngine->pDrawPixels != NULL) && (radius > 0))
+  {
+    if (radius > MAX_BLUR_RADIUS) radius = MAX_BLUR_RADIUS;
+
+    int pixstep = PIX_STEP(pEngine), valstep = VAL_STEP(pEngine);
+    byte *ppixs = (pEngine->pDrawPixels + (startpos * pixstep));
+    int count = (endpos - startpos + 1);
+    int ringlen = radius + 1;
+
+    // original values that have been overwritten but are still within the window
+    byte ring[(MAX_BLUR_RADIUS+1) * PIXEL_CHANNELS];
+
+    uint16_t sums[PIXEL_CHANNELS] = {0};
+    int inwin = 0; // number of pixels currently in the window
+
+    for (int i = 0; (i <= radius) && (i < count); ++i, ++inwin)
+    {
+      byte *p = ppixs + (i * pixstep);
+      sums[0] += p[0];
+      sums[1] += p[valstep];
+      sums[2] += p[2*valstep];
+      #if (PIXEL_CHANNELS == 4)
+      sums[3] += p[3*valstep];
+      #endif
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+      byte *p = ppixs + (i * pixstep);
+      byte *r = ring + ((i % ringlen) * PIXEL_CHANNELS);
+
+      r[0] = p[0]; r[1] = p[valstep]; r[2] = p[2*valstep];
+
+      p[0]         = sums[0] / inwin;
+      p[valstep]   = sums[1] / inwin;
+      p[2*valstep] = sums[2] / inwin;
+
+      #if (PIXEL_CHANNELS == 4)
+      r[3] = p[3*valstep];
+      p[3*valstep] = sums[3] / inwin;
+      #endif
+
+      if ((i + radius + 1) < count) // pixel entering the window is still unmodified
+      {
+        byte *pnew = p + ((radius + 1) * pixstep);
+        sums[0] += pnew[0];
+        sums[1] += pnew[valstep];
+        sums[2] += pnew[2*valstep];
+        #if (PIXEL_CHANNELS == 4)
+        sums[3] += pnew[3*valstep];
+        #endif
+        ++inwin;
+      }
+
+      if (i >= radius) // pixel leaving the window is taken from the ring
+      {
+        byte *pold = ring + (((i - radius) % ringlen) * PIXEL_CHANNELS);
+        sums[0] -= pold[0];
+        sums[1] -= pold[1];
+        sums[2] -= pold[2];
+        #if (PIXEL_CHANNELS == 4)
+        sums[3] -= pold[3];
+        #endif
+        --inwin;
+      }
+    }
+  }
+}
+
+void PixelNutSupport::mirrorPixels(PixelNutHandle handle, uint16_t startpos, uint16_t endpos, uint16_t newpos)
+{
+  PixelNutEngine *pEngine = (PixelNutEngine*)handle;
+  if (pEngine->pDrawPixels != NULL)
+  {
+    // the source and destination ranges must not overlap
+    int pixstep = PIX_STEP(pEngine), valstep = VAL_STEP(pEngine);
+    byte *ppixs1 = (pEngine->pDrawPixels + (endpos * pixstep));
+    byte *ppixs2 = (pEngine->pDrawPixels + (newpos * pixstep));
+
+    for (int i = (endpos - startpos); i >= 0; --i, ppixs1 -= pixstep, ppixs2 += pixstep)
+    {
+      ppixs2[0]         = ppixs1[0];
+      ppixs2[valstep]   = ppixs1[valstep];
+      ppixs2[2*valstep] = ppixs1[2*valstep];
+      #if (PIXEL_CHANNELS == 4)
+      ppixs2[3*valstep] = ppixs1[3*valstep];
+      #endif
+    }
+  }
+}
+
+void PixelNutSupport::persistPixels(PixelNutHandle handle, uint16_t startpos, uint16_t endpos, byte *phistory, byte decay)
+{
+  PixelNutEngine *pEngine = (PixelNutEngine*)handle;
+  if ((pEngine->pDrawPixels != NULL) && (phistory != NULL))
+  {
+    int pixstep = PIX_STEP(pEngine), valstep = VAL_STEP(pEngine);
+    int count = (endpos - startpos + 1) * pixstep;
+
+    // the history is decayed, and then kept wherever it's brighter than the new value
+    // (the history is kept in the same layout as the pixels, one plane after another)
+    for (int c = 0; c < (PIXEL_CHANNELS / pixstep); ++c, phistory += count)
+    {
+      byte *ppixs = (pEngine->pDrawPixels + (startpos * pixstep) + (c * valstep));
+      for (int i = 0; i < count; ++i)
+      {
+        byte val = ((uint16_t)phistory[i] * decay) >> 8;
+        if (val < ppixs[i]) val = ppixs[i];
+        phistory[i] = ppixs[i] = val;
+      }
+    }
+  }
+}
+
+long PixelNutSupport::randomValue(long min, long max)
+{
+  if (randomState == 0) return random(min, max);
+  if (max <= min) return min;
+
+  // xorshift32: never produces 0 from a non-zero state
+  randomState ^= (randomState << 13);
+  randomState ^= (randomState >> 17);
+  randomState ^= (randomState << 5);
+
+  return min + (long)(randomState % (uint32_t)(max - min));
+}
+
+void PixelNutSupport::setRandomSeed(uint32_t seed)
+{
+  randomState = seed;
+}
+
+uint32_t PixelNutSupport::getRandomSeed(void)
+{
+  return randomState;
+}
+
 long PixelNutSupport::mapValue(long inval, long in_min, long in_max, long out_min, long out_max)
 {
   return ((inval - in_min) * (out_max - out_min) / (in_max - in_min)) + out_min;
@@ -202,8 +743,121 @@ long PixelNutSupport::clipValue(long inval, long out_min, long out_max)
   return inval;
 }
 
-void PixelNutSupport::sendForce(PixelNutHandle handle, byte id, short force)
+// Within each power of 2 the float sum changes by the same amount each time (after the first
+// one), so once it has twice those are all added at once, as long as the sum stays within
+// that power of 2 (by another step, so that it's still rounded the same way). The sums are
+// then exact, so this takes about one pass for each power of 2 instead of one for each step.
+uint32_t PixelNutSupport::addFloatSteps(float *pvalue, float step, uint32_t count, double minval, double maxval)
+{
+  float value = *pvalue;
+  float prevvalue = value; // before the previous step
+  float prevchange = 0.0;
+  uint32_t added = 0;
+
+  while (added < count)
+  {
+    float sum = value + step;
+    if ((sum < minval) || (sum > maxval)) break;
+    ++added;
+
+    float change = sum - value;
+    if (change == 0.0) // stuck at this value
+    {
+      added = count;
+      break;
+    }
+
+    int exp1, exp2;
+    frexp(prevvalue, &exp1);
+    frexp(sum, &exp2);
+    bool same = ((change == prevchange) && (exp1 == exp2));
+    prevvalue = value;
+    prevchange = change;
+    value = sum;
+    if (!same) continue;
+
+    float limit = ((change > 0) ? ldexp(1.0, exp2) : ldexp(0.5, exp2));
+    uint32_t more = (count - added);
+    float estimate = ((limit - value) / change);
+    if (estimate < (float)more) more = ((estimate > 1) ? (uint32_t)estimate : 1);
+
+    // the estimate may be off by one, but the sums here are exact
+    while (more > 0)
+    {
+      sum = value + (more * change);
+      if ((change > 0) ? (((sum + change) < limit) && (sum <= maxval)) :
+                         (((sum + change) >= limit) && (sum >= minval))) break;
+      --more;
+    }
+    if (more > 0)
+    {
+      value = sum;
+      prevvalue = value - change;
+      added += more;
+    }
+  }
+
+  *pvalue = value;
+  return added;
+}
+
+void PixelNutSupport::sendForce(PixelNutHandle handle, uint16_t id, short force)
 {
   PixelNutEngine *pEngine = (PixelNutEngine*)handle;
   pEngine->triggerForce(id, force);
 }
+
+#if PIXELNUT_MEMSTATS
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Memory accounting: each allocation starts with a header that records what it's charged to
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct // 8 bytes, which keeps the memory following it aligned
+{
+  uint32_t size;                // number of bytes requested
+  uint16_t layer;               // effect layer charged with it (MAX_WORD_VALUE for the engine)
+  uint16_t charged;             // non-zero if it was charged to an engine
+}
+MemHeader;
+
+void *PixelNutSupport::memAlloc(size_t size)
+{
+  MemHeader *p = (MemHeader*)malloc(sizeof(MemHeader) + size);
+  if (p == NULL) return NULL;
+
+  p->size = size;
+  p->layer = memLayer;
+  p->charged = (memHandle != NULL);
+  if (p->charged) ((PixelNutEngine*)memHandle)->memCharge(p->layer, size);
+
+  return (p + 1);
+}
+
+void *PixelNutSupport::memRealloc(void *ptr, size_t size)
+{
+  if (ptr == NULL) return memAlloc(size);
+
+  MemHeader *p = ((MemHeader*)ptr - 1);
+  int32_t oldsize = p->size;
+
+  p = (MemHeader*)realloc(p, sizeof(MemHeader) + size);
+  if (p == NULL) return NULL;
+
+  p->size = size;
+  if (p->charged && (memHandle != NULL))
+    ((PixelNutEngine*)memHandle)->memCharge(p->layer, ((int32_t)size - oldsize));
+
+  return (p + 1);
+}
+
+void PixelNutSupport::memFree(void *ptr)
+{
+  if (ptr == NULL) return;
+
+  MemHeader *p = ((MemHeader*)ptr - 1);
+  if (p->charged && (memHandle != NULL))
+    ((PixelNutEngine*)memHandle)->memCharge(p->layer, -(int32_t)p->size);
+
+  free(p);
+}
+#endif
@@ -19,6 +19,7 @@
 #include "plugins/PNP_Twinkle.h"
 #include "plugins/PNP_Blinky.h"
 #include "plugins/PNP_Noise.h"
+#include "plugins/PNP_HueGradient.h"
 #include "plugins/PNP_HueSet.h"
 #include "plugins/PNP_HueRotate.h"
 #include "plugins/PNP_ColorMeld.h"
@@ -34,6 +35,10 @@
 #include "plugins/PNP_BrightWave.h"
 #include "plugins/PNP_WinExpander.h"
 #include "plugins/PNP_FlipDirection.h"
+#include "plugins/PNP_PostBlur.h"
+#include "plugins/PNP_PostTrails.h"
+#include "plugins/PNP_PostMirror.h"
+#include "plugins/PNP_PostKaleido.h"
 
 extern PluginFactory *pPluginFactory; // use externally declared pointer to instance
 
@@ -57,6 +62,8 @@ PixelNutPlugin *PluginFactory::makePlugin(int plugin)
     case 51:  return new PNP_Blinky;                      // blinks on and off 'N' random pixels using current color and brightness
     case 52:  return new PNP_Noise;                       // sets 'N' randomly chosen pixels with a random brightness and current color
 
+    case 60:  return new PNP_HueGradient;                 // rainbow of hues that moves, starting at current hue; count property sets number of rainbows
+
     // predraw effects:
 
     case 100: return new PNP_HueSet;                      // force directly sets the color hue property value once when triggered
@@ -81,9 +88,39 @@ PixelNutPlugin *PluginFactory::makePlugin(int plugin)
 
     case 160: return new PNP_FlipDirection;               // toggles the drawing direction on each trigger
 
+    // postdraw effects:
+
+    case 200: return new PNP_PostBlur;                    // blurs merged pixels with their neighbors; force sets the blur radius
+    case 201: return new PNP_PostTrails;                  // leaves fading trails behind merged pixels; force sets how long they last
+    case 202: return new PNP_PostMirror;                  // reflects one half of the merged pixels onto the other half
+    case 203: return new PNP_PostKaleido;                 // repeats first section of merged pixels, alternately reversed; force sets sections
+
     default:  return NULL;
   }
 }
 
+// fused kernels: the predraw effect is stepped first, as the engine would do it, and then the
+// drawing effect draws its pixels with the span routines, without any virtual calls
+template <class PREDRAW, class REDRAW>
+static void FusedStep(PixelNutHandle handle, PixelNutPlugin *pPredraw,
+                      PixelNutPlugin *pRedraw, PixelNutSupport::DrawProps *pdraw)
+{
+  ((PREDRAW*)pPredraw)->PREDRAW::nextstep(handle, pdraw);
+  ((REDRAW*)pRedraw)->fusedstep(handle, pdraw);
+}
+
+PixelNutFusedStep PluginFactory::makeFused(int redrawPlugin, int predrawPlugin)
+{
+  switch (redrawPlugin)
+  {
+    case 0:  if (predrawPlugin == 142) return FusedStep<PNP_BrightWave, PNP_DrawAll>;     break;
+    case 10: if (predrawPlugin == 101) return FusedStep<PNP_HueRotate, PNP_LightWave>;    break;
+    case 30: if (predrawPlugin == 122) return FusedStep<PNP_CountWave, PNP_FerrisWheel>;  break;
+  }
+  return NULL;
+}
+
 // must provide destructor for plugin abstract (interface) base class
 PixelNutPlugin::~PixelNutPlugin() {}
+
+uint16_t PixelNutPlugin::newSize = 0; // set when each plugin is created
@@ -0,0 +1,338 @@
+// PixelNut! Example Application
+//
+// Copyright(c) 2017, Greg de Valois, www.devicenut.com
+//
+/*---------------------------------------------------------------------------------------------
+ This is free software: you can redistribute it and/or modify it under the terms of the GNU
+ Lesser General Public License as published by the Free Software Foundation, version 3 or later.
+ http://www.gnu.org/licenses/
+
+ This is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+---------------------------------------------------------------------------------------------*/
+
+// Reports how long each call to updateEffects() takes on average, first for a pattern of each
+// of the drawing plugins in the factory by itself, then for the combinations of effects that
+// are stepped by fused kernels, and then for patterns with several tracks that overlap, and
+// postdraw effects, which are mostly spent merging and altering the pixels. Then the tracks
+// are only merged (and almost never redrawn) for different numbers of tracks and strip lengths,
+// up to MERGE_MAX_PIXELS, which can be set much longer on computers (such as 65000). Lastly a
+// track has a chain of thousands of predraw effects, each triggered by the one before it ('A'),
+// up to CHAIN_MAX_LAYERS, or as many as there is memory for.
+// No pixels are shown. The engine is given a clock that is stepped further than the longest
+// delay on each frame, so that every track is redrawn each time. Compare the results with the
+// library compiled with and without PIXELNUT_PLANAR, with different PIXELNUT_MERGE_BLOCK sizes,
+// or after any change to the engine.
+// With the library (and this) compiled with PIXELNUT_PROFILE set to 1, the hardware counters
+// of the processor (see PerfCounters.h, only read on Linux) are also read around each call to
+// each effect's nextstep(), the merging of the tracks, and execCmdStr(), and the totals of each
+// are reported at the end, for each call (which for merging is each frame) and for 1000 pixels.
+// The times above then include reading the counters.
+
+#include <Arduino.h>
+#include <PixelNutLib.h>
+#if PIXELNUT_PROFILE
+#include "PerfCounters.h"
+#endif
+
+#define PIXEL_COUNT       300
+#define FRAMES_PER_TEST   2000    // number of frames timed for each pattern
+#define MAX_PLUGIN_ID     255     // highest plugin number looked for in the factory
+
+#define MSECS_PER_FRAME   (MAX_DELAY_VALUE + 1) // every track is redrawn
+#define MERGE_MAX_PIXELS  PIXEL_COUNT   // longest strip that tracks are merged on
+#define MERGE_MAX_TRACKS  8             // most tracks merged
+#define CHAIN_MAX_LAYERS  10000         // most predraw effects chained together
+
+static uint32_t msecsNow = 1;
+static uint32_t GetMsecs(void) { return msecsNow; }
+
+byte pixelArray[((MERGE_MAX_PIXELS > PIXEL_COUNT) ? MERGE_MAX_PIXELS : PIXEL_COUNT) * PIXEL_CHANNELS];
+byte *pPixelData = pixelArray;
+
+PixelValOrder pixorder = {1,0,2};
+PixelNutSupport pixelNutSupport = PixelNutSupport(GetMsecs, &pixorder);
+PixelNutEngine pixelNutEngine = PixelNutEngine(pPixelData, PIXEL_COUNT);
+
+PluginFactory pluginFactory = PluginFactory();
+PluginFactory *pPluginFactory = &pluginFactory;
+
+// patterns with the combinations that have fused kernels in the factory
+static const char *fusedPatterns[] =
+{
+  "E0 T E142 F500 T",                                           // bright wave on all pixels
+  "E10 T E101 F500 T",                                          // light wave with rotating hue
+  "E30 C10 T E122 F500 T",                                      // ferris wheel with count wave
+};
+
+// patterns that are mostly merging tracks and altering the merged pixels
+static const char *mergePatterns[] =
+{
+  "E60 T E0 H120 C20 T E10 H240 T E40 C50 T",                   // 4 overlapping tracks
+  "E60 T E0 H120 C20 V T E10 H240 V T E40 C50 V T",             // same, but overwriting
+  "X0 Y150 E60 T X100 Y150 E10 T X200 Y100 E20 T X50 Y200 E52 C80 T", // segments
+  "E60 T E50 C100 T E200 F500 T",                                // blurred
+  "E20 T E20 H120 T E201 F800 T",                                // trails
+  "E60 T E10 T E202 T E203 F300 T",                              // mirrored sections
+  "E60 T E10 M T E40 C50 T E30 M2 T",                            // masked groups
+  "E60 D0 T E10 D0 T E20 D0 T E50 D0 C100 T E200 F1000 T E201 F1000 T", // all of the above
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// strip lengths that the tracks are merged on (those up to MERGE_MAX_PIXELS)
+static const uint32_t mergeLengths[] = { 60, 300, 1200, 4800, 19200, 65000 };
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#if PIXELNUT_PROFILE
+
+typedef struct // totals for each region of the engine's work
+{
+  uint32_t calls;
+  uint64_t pixels;
+  uint64_t counts[PERF_NUM_COUNTS];
+}
+ProfileTotals;
+
+static ProfileTotals stepTotals[MAX_PLUGIN_ID+1]; // for the nextstep() of each plugin
+static ProfileTotals mergeTotals, commandTotals;
+
+static PerfCounters perfCounters;
+static uint64_t startCounts[PERF_NUM_COUNTS];
+
+static void Profile(byte region, uint16_t plugin, uint16_t pixels, bool start)
+{
+  if (start)
+  {
+    perfCounters.read(startCounts);
+    return;
+  }
+
+  uint64_t counts[PERF_NUM_COUNTS];
+  perfCounters.read(counts);
+
+  ProfileTotals *ptotals;
+  if (region == PROFILE_MERGE) ptotals = &mergeTotals;
+  else if (region == PROFILE_COMMAND) ptotals = &commandTotals;
+  else if (plugin <= MAX_PLUGIN_ID) ptotals = &stepTotals[plugin];
+  else return;
+
+  ++ptotals->calls;
+  ptotals->pixels += pixels;
+  for (int i = 0; i < PERF_USECS; ++i) ptotals->counts[i] += counts[i] - startCounts[i];
+  ptotals->counts[PERF_USECS] += (uint32_t)(counts[PERF_USECS] - startCounts[PERF_USECS]);
+}
+
+// appends 'num'/'den' with 2 decimal places to 's', returning the end of it
+static char *AddRatio(char *s, uint64_t num, uint64_t den)
+{
+  uint64_t val = (den ? (((num * 100) + (den/2)) / den) : 0);
+  return s + sprintf(s, "%lu.%02u", (unsigned long)(val / 100), (unsigned)(val % 100));
+}
+
+// reports the counts of 'ptotals' for each call and for each 1000 pixels
+static void ReportTotals(const char *name, ProfileTotals *ptotals)
+{
+  if (ptotals->calls == 0) return;
+
+  char str[250];
+  char *s = str + sprintf(str, "  %s x%lu:", name, (unsigned long)ptotals->calls);
+  for (int i = 0; i < PERF_NUM_COUNTS; ++i)
+  {
+    if (!perfCounters.available(i)) continue;
+    s += sprintf(s, " %s=", perfNames[i]);
+    s = AddRatio(s, ptotals->counts[i], ptotals->calls);
+    *s++ = '/';
+    s = AddRatio(s, (ptotals->counts[i] * 1000), ptotals->pixels);
+  }
+  Serial.println(str);
+}
+
+static void ReportProfile(void)
+{
+  char str[120];
+  char *s = str + sprintf(str, "Profiled regions (per call/per 1000 pixels), counters:");
+  int count = 0;
+  for (int i = 0; i < PERF_USECS; ++i)
+    if (perfCounters.available(i))
+    {
+      s += sprintf(s, " %s", perfNames[i]);
+      ++count;
+    }
+  if (count == 0) sprintf(s, " (none available, only the time)");
+  Serial.println(str);
+
+  for (int id = 0; id <= MAX_PLUGIN_ID; ++id)
+  {
+    sprintf(str, "E%d", id);
+    ReportTotals(str, &stepTotals[id]);
+  }
+  ReportTotals("merge", &mergeTotals);
+  ReportTotals("command", &commandTotals);
+}
+
+#endif
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static char cmdStr[200]; // altered by execCmdStr()
+
+// returns the average usecs for each frame of the pattern that has been loaded, stepping the
+// clock by 'msecs' on each frame
+static uint32_t TimeFrames(uint32_t msecs)
+{
+  uint32_t usecs = micros();
+  for (int i = 0; i < FRAMES_PER_TEST; ++i)
+  {
+    msecsNow += msecs;
+    pixelNutEngine.updateEffects();
+  }
+  usecs = micros() - usecs;
+
+  return ((usecs + (FRAMES_PER_TEST/2)) / FRAMES_PER_TEST);
+}
+
+// returns the average usecs for each frame of 'pattern', stepping the clock by 'msecs' on
+// each frame, or 0 if it couldn't be loaded
+static uint32_t TimePattern(const char *pattern, uint32_t msecs=MSECS_PER_FRAME)
+{
+  pixelNutEngine.clearStack();
+
+  sprintf(cmdStr, "P %s G", pattern);
+  if (pixelNutEngine.execCmdStr(cmdStr) != PixelNutEngine::Status_Success) return 0;
+
+  return TimeFrames(msecs);
+}
+
+static void Report(const char *pattern)
+{
+  char str[120];
+  uint32_t usecs = TimePattern(pattern);
+  if (usecs == 0) sprintf(str, "  (failed) %s", pattern);
+  else sprintf(str, "  %5lu usecs: %s", (unsigned long)usecs, pattern);
+  Serial.println(str);
+}
+
+// reports the usecs for each frame, and for each 1000 pixels, of merging 'tracks' full length
+// tracks on each of the strip lengths: a single pixel is redrawn on each frame, while all of
+// the other tracks are only redrawn every MAX_DELAY_VALUE frames
+static void ReportMerge(int tracks)
+{
+  char pattern[20 + (MERGE_MAX_TRACKS * 16)];
+  char *p = pattern + sprintf(pattern, "X0 Y1 E0 D0 T X0 Y");
+  for (int i = 0; i < tracks; ++i)
+    p += sprintf(p, " E0 H%d D%d T", ((i * 45) % 360), MAX_DELAY_VALUE);
+
+  char str[120];
+  char *s = str + sprintf(str, "  %d tracks:", tracks);
+
+  for (unsigned i = 0; i < (sizeof(mergeLengths) / sizeof(mergeLengths[0])); ++i)
+  {
+    if (mergeLengths[i] > MERGE_MAX_PIXELS) break;
+
+    pixelNutEngine.clearStack();
+    if (!pixelNutEngine.resize(pPixelData, mergeLengths[i])) break;
+
+    uint32_t usecs = TimePattern(pattern, 1);
+    s += sprintf(s, " %lu=%lu/%lu", (unsigned long)mergeLengths[i], (unsigned long)usecs,
+                 (unsigned long)(((usecs * 1000) + (mergeLengths[i]/2)) / mergeLengths[i]));
+  }
+  Serial.println(str);
+
+  pixelNutEngine.clearStack();
+  pixelNutEngine.resize(pPixelData, PIXEL_COUNT);
+}
+
+// reports the usecs for each frame, and for each 1000 layers, of a track with 'layers' bright
+// waves that are chained together: each is triggered by the one before it (with 'A') when its
+// wave ends, so that forces are sent along the chain, and all of them are checked for automatic
+// triggering and stepped on each frame; returns false if the pattern couldn't be loaded
+static bool ReportChain(int layers)
+{
+  pixelNutEngine.clearStack();
+
+  char *pattern = (char*)malloc(20 + (layers * 22)); // too long for 'cmdStr'
+  if (pattern == NULL) return false;
+
+  // the first layer is the drawing effect, with the chain starting from it
+  char *p = pattern + sprintf(pattern, "P E0 D0 T");
+  for (int i = 1; i <= layers; ++i)
+    p += sprintf(p, " E142 F%d A%d T", (100 + ((i * 37) % 900)), (i-1));
+  strcpy(p, " G");
+
+  bool success = (pixelNutEngine.execCmdStr(pattern) == PixelNutEngine::Status_Success);
+  free(pattern);
+  if (!success) return false;
+
+  uint32_t usecs = TimeFrames(MSECS_PER_FRAME);
+  pixelNutEngine.clearStack();
+
+  char str[80];
+  sprintf(str, "  %d layers: %lu usecs, %lu per 1000 layers", layers, (unsigned long)usecs,
+          (unsigned long)(((usecs * 1000) + (layers/2)) / layers));
+  Serial.println(str);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void setup()
+{
+  Serial.begin(115200);
+
+  char str[80];
+  sprintf(str, "Pixels=%d Channels=%d Planar=%d Block=%d", PIXEL_COUNT, PIXEL_CHANNELS,
+          PIXELNUT_PLANAR, PIXELNUT_MERGE_BLOCK);
+  Serial.println(str);
+
+  #if PIXELNUT_PROFILE
+  pixelNutEngine.setProfiler(Profile);
+  #endif
+
+  Serial.println("Drawing plugins:");
+  for (int id = 0; id <= MAX_PLUGIN_ID; ++id)
+  {
+    PixelNutPlugin *pPlugin = pPluginFactory->makePlugin(id);
+    if (pPlugin == NULL) continue;
+
+    bool redraw = (pPlugin->gettype() & PLUGIN_TYPE_REDRAW);
+    delete pPlugin;
+
+    if (redraw)
+    {
+      sprintf(str, "E%d C50 T", id);
+      Report(str);
+    }
+  }
+
+  Serial.println("Fused patterns:");
+  for (unsigned i = 0; i < (sizeof(fusedPatterns) / sizeof(fusedPatterns[0])); ++i)
+    Report(fusedPatterns[i]);
+
+  Serial.println("Merged patterns:");
+  for (unsigned i = 0; i < (sizeof(mergePatterns) / sizeof(mergePatterns[0])); ++i)
+    Report(mergePatterns[i]);
+
+  Serial.println("Merging tracks (pixels=usecs per frame/per 1000 pixels):");
+  for (int tracks = 1; tracks <= MERGE_MAX_TRACKS; tracks *= 2)
+    ReportMerge(tracks);
+
+  Serial.println("Chained layers:");
+  for (int layers = 10; layers <= CHAIN_MAX_LAYERS; layers *= 10)
+    if (!ReportChain(layers))
+    {
+      sprintf(str, "  %d layers: (failed)", layers);
+      Serial.println(str);
+      break;
+    }
+
+  pixelNutEngine.clearStack();
+
+  #if PIXELNUT_PROFILE
+  pixelNutEngine.setProfiler(NULL);
+  ReportProfile();
+  #endif
+}
+
+void loop()
+{
+}
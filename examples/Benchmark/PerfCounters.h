@@ -0,0 +1,139 @@
+// What It Does:
+//
+//    Reads the hardware performance counters of the processor: the cycles, instructions,
+//    cache misses and branch misses, counted only while in the application itself (not in
+//    the kernel), along with the time in microseconds.
+//
+// Where It Works:
+//
+//    Only when the benchmark is compiled and run on Linux, with the perf_event interface.
+//    On a microcontroller, or where the counters cannot be opened (in most containers and
+//    virtual machines, or when /proc/sys/kernel/perf_event_paranoid is more than 2), each
+//    counter that isn't available reads as 0, and available() returns false for it. The
+//    time is always available.
+//
+// Calling read():
+//
+//    Stores the current values of all of the counters, which are only useful as the
+//    difference between two reads. Each read is a system call, which takes about as long
+//    as merging a few hundred pixels, and is included in the time, but not in the counters.
+//
+
+#define PERF_CYCLES               0
+#define PERF_INSTRUCTIONS         1
+#define PERF_CACHE_MISSES         2
+#define PERF_BRANCH_MISSES        3
+#define PERF_USECS                4   // always available
+#define PERF_NUM_COUNTS           5
+
+static const char *perfNames[PERF_NUM_COUNTS] = { "cycles", "instrs", "cache-misses", "branch-misses", "usecs" };
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+class PerfCounters
+{
+public:
+  PerfCounters(void)
+  {
+    static const uint32_t configs[PERF_USECS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                  PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+
+    // all of the counters that can be opened are in one group, so they're read together
+    for (int i = 0; i < PERF_USECS; ++i)
+    {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = configs[i];
+      attr.disabled = (leaderFd < 0);
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+      int fd = syscall(__NR_perf_event_open, &attr, 0, -1, leaderFd, 0);
+      if (fd < 0) continue; // not available
+
+      if (leaderFd < 0) leaderFd = fd;
+      fds[numOpen] = fd;
+      which[numOpen++] = i;
+    }
+
+    if (leaderFd >= 0)
+    {
+      ioctl(leaderFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(leaderFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+      // some virtual machines open the counters, but never actually count with them
+      uint64_t counts[PERF_NUM_COUNTS];
+      for (volatile int i = 0; i < 100000; ++i);
+      if (!ReadGroup(counts)) Close();
+    }
+  }
+
+  ~PerfCounters() { Close(); }
+
+  // returns true if counter 'count' (one of the PERF_ values) is being read
+  bool available(byte count)
+  {
+    if (count == PERF_USECS) return true;
+    for (int i = 0; i < numOpen; ++i)
+      if (which[i] == count) return true;
+    return false;
+  }
+
+  void read(uint64_t *pcounts)
+  {
+    if ((leaderFd < 0) || !ReadGroup(pcounts))
+      for (int i = 0; i < PERF_USECS; ++i) pcounts[i] = 0;
+
+    pcounts[PERF_USECS] = micros();
+  }
+
+private:
+
+  int fds[PERF_USECS];
+  byte which[PERF_USECS];         // which counter is in each position of the group
+  int numOpen = 0;
+  int leaderFd = -1;
+
+  // reads all of the counters in the group, returning false if they haven't been counting
+  bool ReadGroup(uint64_t *pcounts)
+  {
+    struct { uint64_t nr, enabled, running, values[PERF_USECS]; } group;
+    if (::read(leaderFd, &group, sizeof(group)) < (ssize_t)(3 * sizeof(uint64_t))) return false;
+    if (group.running == 0) return false;
+
+    for (int i = 0; i < PERF_USECS; ++i) pcounts[i] = 0;
+    for (int i = 0; (i < numOpen) && (i < (int)group.nr); ++i)
+      pcounts[which[i]] = group.values[i];
+    return true;
+  }
+
+  void Close(void)
+  {
+    for (int i = 0; i < numOpen; ++i) close(fds[i]);
+    numOpen = 0;
+    leaderFd = -1;
+  }
+};
+
+#else // only the time is available
+
+class PerfCounters
+{
+public:
+  bool available(byte count) { return (count == PERF_USECS); }
+
+  void read(uint64_t *pcounts)
+  {
+    for (int i = 0; i < PERF_USECS; ++i) pcounts[i] = 0;
+    pcounts[PERF_USECS] = micros();
+  }
+};
+
+#endif
@@ -19,7 +19,7 @@
 #define DPIN_PIXELS   17
 #define PIXEL_COUNT   60
 
-byte pixelArray[PIXEL_COUNT*3];
+byte pixelArray[PIXEL_COUNT*PIXEL_CHANNELS];
 byte *pPixelData = pixelArray;
 NeoPixelShow neoPixels = NeoPixelShow(DPIN_PIXELS);
 
@@ -54,5 +54,5 @@ void setup()
 void loop()
 {
   if (pixelNutEngine.updateEffects())
-    neoPixels.show(pPixelData, PIXEL_COUNT*3);
+    neoPixels.show(pPixelData, PIXEL_COUNT*PIXEL_CHANNELS);
 }
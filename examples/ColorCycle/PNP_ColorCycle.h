@@ -20,7 +20,7 @@
 //    degreeHue, pcentWhite - modified after so many calls to nextstep().
 //
 
-class PNP_ColorCycle : public PixelNutPlugin
+class PNP_ColorCycle : public PixelNutSequence
 {
 public:
   byte gettype(void) const
@@ -28,29 +28,44 @@ public:
     return 0;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
-      max = 0;
-      count = 1;
-      index = 0;
+      seqRestart();
   }
 
+  // written as a sequence of steps (see PixelNutSequence.h), which continues
+  // from the last SEQ_YIELD() each time this is called
   void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
   {
-    if (max == 0) max = pdraw->pixCount * 3;
+    SEQ_BEGIN();
 
-    if (count++ >= max)
+    max = pdraw->pixCount * 3;
+
+    while (true)
     {
-      pdraw->degreeHue = hues[index];
-      pdraw->pcentWhite = whites[index];
-      pixelNutSupport.makeColorVals(pdraw);
+      for (index = 0; index < 3; ++index)
+      {
+        for (count = 1; count < max; ++count)
+          SEQ_YIELD(); // do nothing for all but the last of 'max' steps
 
-      count = 1;
-      if (++index >= 3) index = 0;
+        SetColor(pdraw);
+        SEQ_YIELD(); // which sets the next color
+      }
     }
+
+    SEQ_END();
   }
 
 private:
+  void SetColor(PixelNutSupport::DrawProps *pdraw)
+  {
+    bool doset = pixelNutSupport.setPropHue(pdraw, hues[index]);
+    if (pixelNutSupport.setPropWhite(pdraw, whites[index]))
+      doset = true;
+
+    if (doset) pixelNutSupport.makeColorVals(pdraw);
+  }
+
     uint16_t count, max;
     uint16_t index;
     // cycles through Red, White, Blue
@@ -0,0 +1,330 @@
+// PixelNut! Example Application
+//
+// Copyright(c) 2017, Greg de Valois, www.devicenut.com
+//
+/*---------------------------------------------------------------------------------------------
+ This is free software: you can redistribute it and/or modify it under the terms of the GNU
+ Lesser General Public License as published by the Free Software Foundation, version 3 or later.
+ http://www.gnu.org/licenses/
+
+ This is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+---------------------------------------------------------------------------------------------*/
+
+// Runs the engine for as long as it's left running, with random patterns made from all of the
+// plugins in the factory, switched at random times, with random triggers and property changes
+// in between. No pixels are shown: instead it reports how long each call to updateEffects()
+// took (the median, the slowest 1% and 0.1%, and the slowest of all), and how many patterns
+// failed to load. Compiled with PIXELNUT_MEMSTATS it also reports the memory used, and checks
+// that all of it is freed each time a pattern is cleared.
+//
+// The engine is given a clock that is stepped by the frame time instead of the real one, so
+// that it runs as fast as it can, starting a minute before the 32-bit msecs value rolls over,
+// to check that nothing stalls or runs away when that happens.
+
+#include <Arduino.h>
+#include <PixelNutLib.h>
+
+#define PIXEL_COUNT       60
+#define FRAMES_PER_REPORT 100000  // number of frames between each report
+#define LOOP_CACHE_FRAMES 0       // frames in the loop cache (0 to not use it)
+
+#define MAX_PLUGIN_ID     255     // highest plugin number looked for in the factory
+#define MAX_PLUGINS       64      // most plugins of each type that are used
+#define MAX_PATTERN_LEN   1000    // longest pattern string that can be generated
+#define MAX_PATTERN_TRACKS 4      // most tracks in each pattern
+#define MAX_TRACK_LAYERS  3       // most predraw and postdraw layers on each track
+
+#define LATENCY_BUCKETS   128     // 8 per power of 2 (with 3 bits of precision), up to 262 msecs
+
+static uint32_t msecsNow = (0xFFFFFFFF - 60000); // rolls over after a minute
+static uint32_t GetMsecs(void) { return msecsNow; }
+
+byte pixelArray[PIXEL_COUNT*PIXEL_CHANNELS];
+byte *pPixelData = pixelArray;
+
+PixelValOrder pixorder = {1,0,2};
+PixelNutSupport pixelNutSupport = PixelNutSupport(GetMsecs, &pixorder);
+PixelNutEngine pixelNutEngine = PixelNutEngine(pPixelData, PIXEL_COUNT);
+
+PluginFactory pluginFactory = PluginFactory();
+PluginFactory *pPluginFactory = &pluginFactory;
+
+static uint16_t redrawPlugins[MAX_PLUGINS];   // plugin numbers found for each type
+static uint16_t otherPlugins[MAX_PLUGINS];    // predraw and postdraw
+static bool sparsePlugins[MAX_PLUGINS];       // which redraw ones are sparse (cannot be masks)
+static int numRedraw = 0;
+static int numOther = 0;
+
+static uint32_t latencyCounts[LATENCY_BUCKETS];
+static uint32_t latencyMax = 0;
+
+static uint32_t countFrames = 0;
+static uint32_t countPatterns = 0;
+static uint32_t countFailed = 0;
+static uint32_t countLeaks = 0;
+static uint32_t framesToSwitch = 0;
+static bool clockWrapped = false;
+
+static char patternStr[MAX_PATTERN_LEN];      // most recent pattern
+static char cmdStr[MAX_PATTERN_LEN];          // altered by execCmdStr()
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int LatencyBucket(uint32_t usecs)
+{
+  if (usecs < 8) return usecs;
+
+  int shift = 0;
+  while ((usecs >> shift) >= 16) ++shift; // keep the top 4 bits
+
+  int index = ((shift + 1) * 8) + ((usecs >> shift) & 7);
+  return ((index < LATENCY_BUCKETS) ? index : (LATENCY_BUCKETS-1));
+}
+
+// returns the smallest value that is beyond the values counted in 'index'
+static uint32_t BucketLimit(int index)
+{
+  ++index;
+  if (index < 8) return index;
+  return ((uint32_t)(8 + (index & 7)) << ((index / 8) - 1));
+}
+
+// returns the latency (usecs) that 'permille' of all the frames took no longer than
+static uint32_t Percentile(uint32_t permille)
+{
+  uint32_t count = ((uint64_t)countFrames * permille + 999) / 1000;
+  uint32_t total = 0;
+
+  for (int i = 0; i < LATENCY_BUCKETS; ++i)
+  {
+    total += latencyCounts[i];
+    if (total >= count) return BucketLimit(i);
+  }
+  return latencyMax;
+}
+
+static void Report(void)
+{
+  char str[100];
+  sprintf(str, "frames=%lu patterns=%lu failed=%lu leaks=%lu%s",
+          (unsigned long)countFrames, (unsigned long)countPatterns,
+          (unsigned long)countFailed, (unsigned long)countLeaks,
+          (clockWrapped ? " (clock wrapped)" : ""));
+  Serial.println(str);
+
+  sprintf(str, "  usecs: p50<%lu p99<%lu p99.9<%lu max=%lu",
+          (unsigned long)Percentile(500), (unsigned long)Percentile(990),
+          (unsigned long)Percentile(999), (unsigned long)latencyMax);
+  Serial.println(str);
+
+  #if PIXELNUT_MEMSTATS
+  PixelNutEngine::MemUsage engine, total, usage;
+  pixelNutEngine.getEngineMemory(&engine, &total);
+
+  uint32_t maxpeak = 0;
+  uint16_t maxplugin = 0, plugin;
+  for (uint16_t i = 0; pixelNutEngine.getLayerMemory(i, &usage, &plugin); ++i)
+  {
+    if (usage.peak > maxpeak)
+    {
+      maxpeak = usage.peak;
+      maxplugin = plugin;
+    }
+  }
+
+  sprintf(str, "  bytes: engine=%lu/%lu total=%lu/%lu layer=%lu (E%u)",
+          (unsigned long)engine.bytes, (unsigned long)engine.peak,
+          (unsigned long)total.bytes, (unsigned long)total.peak,
+          (unsigned long)maxpeak, maxplugin);
+  Serial.println(str);
+  #endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// appends a command with a random value from 'minval' to 'maxval' half of the time
+static char *AddOption(char *p, char cmd, long minval, long maxval)
+{
+  if (random(2)) p += sprintf(p, " %c%ld", cmd, random(minval, maxval+1));
+  return p;
+}
+
+static char *AddTrigger(char *p)
+{
+  switch (random(4))
+  {
+    case 0: break;                                  // only triggered externally
+    case 1: p += sprintf(p, " T"); break;           // only once
+    default:
+    {
+      p = AddOption(p, 'O', 1, 3);
+      p = AddOption(p, 'N', 0, 5);
+      p = AddOption(p, 'R', 0, 4);
+      p += sprintf(p, " T%ld", random(0, 6));       // repeatedly
+      break;
+    }
+  }
+  return p;
+}
+
+static void MakePattern(char *str)
+{
+  char *p = str;
+  p += sprintf(p, "P");
+
+  int tracks = random(1, MAX_PATTERN_TRACKS+1);
+  bool segments = (random(4) == 0);
+  int layer = 0;
+
+  for (int t = 0; t < tracks; ++t)
+  {
+    if (segments)
+    {
+      long start = random(PIXEL_COUNT);
+      p += sprintf(p, " X%ld Y%ld", start, random(1, (PIXEL_COUNT - start + 1)));
+    }
+
+    int plugin = random(numRedraw);
+    p += sprintf(p, " E%u", redrawPlugins[plugin]);
+    p = AddOption(p, 'H', 0, 359);
+    p = AddOption(p, 'W', 0, 100);
+    p = AddOption(p, 'C', 0, 100);
+    p = AddOption(p, 'B', 0, 100);
+    p = AddOption(p, 'D', 0, 100);
+    p = AddOption(p, 'Q', 0, 7);
+    p = AddOption(p, 'U', 0, 1);
+    p = AddOption(p, 'V', 0, 1);
+    p = AddOption(p, 'S', 0, 4);
+    if (random(2)) p += sprintf(p, " F");           // random force on each trigger
+    else p = AddOption(p, 'F', 0, 1000);
+    if (random(2)) p += sprintf(p, " I");
+    if (!sparsePlugins[plugin] && (random(6) == 0)) p += sprintf(p, " M%ld", random(3));
+    p = AddTrigger(p);
+    ++layer;
+
+    int layers = random(0, MAX_TRACK_LAYERS+1);
+    for (int i = 0; (i < layers) && numOther; ++i)
+    {
+      p += sprintf(p, " E%u", otherPlugins[random(numOther)]);
+      p = AddOption(p, 'F', 0, 1000);
+      if (random(2)) p += sprintf(p, " I");
+      if (random(4) == 0) p += sprintf(p, " A%ld", random(layer));
+      p = AddTrigger(p);
+      ++layer;
+    }
+  }
+
+  #if LOOP_CACHE_FRAMES
+  if (random(4) == 0) p = AddOption(p, 'L', 1, LOOP_CACHE_FRAMES);
+  #endif
+
+  sprintf(p, " G");
+}
+
+static void ClearPattern(void)
+{
+  pixelNutEngine.clearStack();
+
+  #if PIXELNUT_MEMSTATS
+  PixelNutEngine::MemUsage engine, total;
+  pixelNutEngine.getEngineMemory(&engine, &total);
+  if (total.bytes != engine.bytes)
+  {
+    char str[50];
+    sprintf(str, "Leaked %lu bytes:", (unsigned long)(total.bytes - engine.bytes));
+    Serial.println(str);
+    Serial.println(patternStr);
+    ++countLeaks;
+  }
+  #endif
+}
+
+static void NextPattern(void)
+{
+  if (random(8) == 0) ClearPattern(); // also check for leaks
+
+  MakePattern(patternStr);
+  ++countPatterns;
+
+  strcpy(cmdStr, patternStr);
+  if (pixelNutEngine.execCmdStr(cmdStr) != PixelNutEngine::Status_Success)
+    ++countFailed;
+
+  framesToSwitch = random(10, 5000);
+}
+
+// makes one of the calls an application makes between updates, sometimes
+static void RandomInput(void)
+{
+  switch (random(200))
+  {
+    case 0: pixelNutEngine.triggerForce(random(-1000, 1001));                 break;
+    case 1: pixelNutEngine.triggerSegForce(random(3), random(0, 1001));       break;
+    case 2: pixelNutEngine.setColorProperty(random(360), random(101));        break;
+    case 3: pixelNutEngine.setCountProperty(random(101));                     break;
+    case 4: pixelNutEngine.setProperties(random(360), random(101), random(101)); break;
+    case 5: pixelNutEngine.setPropertyMode(random(2));                        break;
+    case 6: pixelNutEngine.setMaxBrightness(random(101));                     break;
+    case 7: pixelNutEngine.setDelayOffset(random(-20, 21));                   break;
+    case 8: pixelNutEngine.setTempo(random(0, 200), (msecsNow - random(1000))); break;
+    default: break;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void setup()
+{
+  Serial.begin(115200);
+
+  // find all of the plugins in the factory, and whether they draw pixels
+  for (int id = 0; id <= MAX_PLUGIN_ID; ++id)
+  {
+    PixelNutPlugin *pPlugin = pPluginFactory->makePlugin(id);
+    if (pPlugin == NULL) continue;
+
+    if (pPlugin->gettype() & PLUGIN_TYPE_REDRAW)
+    {
+      if (numRedraw < MAX_PLUGINS)
+      {
+        sparsePlugins[numRedraw] = (pPlugin->gettype() & PLUGIN_TYPE_SPARSE);
+        redrawPlugins[numRedraw++] = id;
+      }
+    }
+    else if (numOther < MAX_PLUGINS) otherPlugins[numOther++] = id;
+
+    delete pPlugin;
+  }
+
+  char str[50];
+  sprintf(str, "Plugins: %d redraw, %d other", numRedraw, numOther);
+  Serial.println(str);
+
+  #if LOOP_CACHE_FRAMES
+  pixelNutEngine.setLoopCache(LOOP_CACHE_FRAMES);
+  #endif
+
+  NextPattern();
+}
+
+void loop()
+{
+  if (numRedraw == 0) return;
+
+  if (--framesToSwitch == 0) NextPattern();
+  RandomInput();
+
+  uint32_t usecs = micros();
+  pixelNutEngine.updateEffects();
+  usecs = micros() - usecs;
+
+  ++latencyCounts[LatencyBucket(usecs)];
+  if (usecs > latencyMax) latencyMax = usecs;
+
+  uint32_t prev = msecsNow;
+  msecsNow += random(1, 30); // the time between frames varies
+  if (msecsNow < prev) clockWrapped = true;
+
+  if ((++countFrames % FRAMES_PER_REPORT) == 0) Report();
+}
@@ -0,0 +1,58 @@
+// PixelNut Frame Codec Class Definition
+// Used by applications to record and play back the output pixels.
+/*
+    Copyright (c) 2015-2024, Greg de Valois
+    Software License Agreement (BSD License)
+    See license.txt for the terms of this license.
+*/
+
+#pragma once
+
+// Each frame of output pixels is encoded as the difference from the previous frame
+// (XOR of the values), as a list of tokens that are each a variable length value
+// (7 bits per byte, lowest first), whose lowest 2 bits are the type of the token,
+// and the rest are a count of bytes or pixels:
+//
+//  CODEC_TOKEN_SKIP:   'count' bytes are unchanged
+//  CODEC_TOKEN_LITERAL 'count' bytes follow that are XORed into the frame
+//  CODEC_TOKEN_REPEAT: PIXEL_CHANNELS bytes follow that are XORed into 'count' pixels
+//  CODEC_TOKEN_END:    the rest of the frame is unchanged
+//
+// The first frame (and the first after a reset) is encoded against all zero values.
+// An encoded frame is never more than (frame_bytes + CODEC_MAX_OVERHEAD) bytes.
+
+#define CODEC_TOKEN_SKIP          0
+#define CODEC_TOKEN_LITERAL       1
+#define CODEC_TOKEN_REPEAT        2
+#define CODEC_TOKEN_END           3
+#define CODEC_MAX_OVERHEAD        4       // max bytes added to frame when encoded
+
+class PixelNutCodec
+{
+public:
+  // Constructor: 'frame_bytes' is the number of bytes in each frame of pixels
+  // (number of pixels * PIXEL_CHANNELS). Only the encoder keeps a copy of the
+  // previous frame, so when 'encoder' is false no memory is allocated.
+  PixelNutCodec(uint32_t frame_bytes, bool encoder=true);
+  ~PixelNutCodec();
+
+  // Starts a new sequence of frames, with the next frame encoded against all zero values.
+  void reset(void);
+
+  // Encodes 'pframe' into 'pout', which has 'maxlen' bytes, returning the number of bytes
+  // written, or 0 if that wasn't enough (in which case the sequence must be reset).
+  uint32_t encodeFrame(const byte *pframe, byte *pout, uint32_t maxlen);
+
+  // Decodes one frame from 'pin', which has 'inlen' bytes, by applying it to 'pframe', which
+  // must hold the previously decoded frame (or all zero values at the start of a sequence).
+  // Returns the number of bytes used, so that frames can be decoded one after another from
+  // a single buffer, or 0 if the data is not valid (in which case 'pframe' is undefined).
+  uint32_t decodeFrame(const byte *pin, uint32_t inlen, byte *pframe);
+
+  // Note: test this for NULL after constructing an encoder to check if successful!
+  byte *pPrevFrame = NULL;        // previous frame that was encoded
+
+protected:
+
+  uint32_t frameBytes;            // number of bytes in each frame
+};
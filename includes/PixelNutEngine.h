@@ -9,8 +9,17 @@
 
 #pragma once
 
+#define MASK_ALL_TRACKS           MAX_BYTE_VALUE  // set with "M0": masks all the tracks below
+
+#define PROFILE_STEP              0   // nextstep() of an effect (or a fused kernel)
+#define PROFILE_MERGE             1   // merging all of the tracks into the output pixels
+#define PROFILE_COMMAND           2   // execCmdStr()
+#define PROFILE_NUM_REGIONS       3
+
 class PixelNutEngine
 {
+  friend class PixelNutJournal; // restores the settings when replaying
+
 public:
 
   enum Status // Returned value from 'execCmdStr()' call below
@@ -27,7 +36,8 @@ public:
   // the corresponding bit set.
   //
   // In addition, when the external property mode is enabled with 'setPropertyMode()',
-  // a set property bit prevents any predraw effect from changing that property for that track.
+  // a set property bit prevents any predraw effect from changing that property for that track
+  // (the bits are copied into the 'extLocks' drawing property, which rejects any such change).
   // Otherwise, a set bit allows modification by both external and internal (predraw) sources.
   //
   // By default (no bits set), only predraw effects can change the drawing properties.
@@ -39,17 +49,32 @@ public:
     ExtControlBit_All        = 7    // all bits ORed together
   };
 
-  // Constructor: init location/length of the pixels to be drawn, 
+  // Constructor: init location/length of the pixels to be drawn (PIXEL_CHANNELS bytes each),
   // the first pixel to start drawing and the direction of drawing,
-  // and the maximum effect layers and tracks that can be supported.
-  // num_layers/tracks *must not* be greater than MAX_TRACK_LAYER.
+  // and the initial number of effect layers and tracks that can be supported.
+  // These are doubled as needed when a pattern uses more, up to MAX_TRACK_LAYER.
   PixelNutEngine(byte *ptr_pixels, uint16_t num_pixels, bool goupwards=true,
                  short num_layers=4, short num_tracks=3);
 
-  void setMaxBrightness(byte percent) { pcentBright = percent; }
+  // Destructor: deletes all of the effects and frees all memory (the pixels are left as they are).
+  virtual ~PixelNutEngine();
+
+  // Changes the location/length of the pixels to be drawn, keeping the current pattern: the
+  // buffer of each track is reallocated, and each effect told its new length with its resize()
+  // method, then triggered again if it had been. Tracks that cover the whole strip are resized
+  // with it, while those in a segment keep their place, but are cut short if they no longer fit.
+  // The count property of each track is kept in proportion to its length, and the loop cache
+  // is reallocated for the new frame size (and freed if that isn't possible). Returns false if
+  // there isn't enough memory to grow the tracks, leaving everything as it was.
+  bool resize(byte *ptr_pixels, uint16_t num_pixels);
+  uint16_t getNumPixels() { return numPixels; }
+
+  void setMaxBrightness(byte percent)
+    { if (pJournal != NULL) pJournal->record(JOURNAL_BRIGHT, percent); pcentBright = percent; LoopReset(); }
   byte getMaxBrightness() { return pcentBright; }
 
-  void setDelayOffset(int8_t msecs) { delayOffset = msecs; }
+  void setDelayOffset(int8_t msecs)
+    { if (pJournal != NULL) pJournal->record(JOURNAL_DELAY, msecs); delayOffset = msecs; LoopReset(); }
   int8_t getDelayOffset() { return delayOffset; }
 
   // Sets the color properties for tracks that have set either the ExtControlBit_DegreeHue
@@ -62,6 +87,11 @@ public:
   // The 'pixcount_percent' value is a percentage from 0...MAX_PERCENTAGE.
   void setCountProperty(byte pixcount_percent);
 
+  // Sets all of the above properties at once, with only a single pass over the tracks.
+  // For all of these, the drawing color of a track isn't recalculated until it's next drawn,
+  // so these can be called at any rate without the cost of a color conversion on each call.
+  void setProperties(short hue_degree, byte white_percent, byte pixcount_percent);
+
   // When enabled, predraw effects are prevented from modifying the color/count properties
   // of a track with the corresponding ExtControlBit bit set, allowing only the external
   // control of that property with calls to set..Property().
@@ -73,69 +103,238 @@ public:
   byte  getPropertyWhite()   { return externPcentWhite; }
   byte  getPropertyCount()   { return externPcentCount; }
 
+  // Same as the above calls, but only for the tracks in one logical segment (created with the
+  // X/Y commands, and numbered from 0 in the order they were defined in the pattern). Only the
+  // tracks in that segment are examined, and the values above for all tracks are unaffected.
+  // The property mode must still be enabled. Invalid segment indices are ignored.
+  void setSegColorProperty(byte segindex, short hue_degree, byte white_percent);
+  void setSegCountProperty(byte segindex, byte pixcount_percent);
+  void setSegProperties(byte segindex, short hue_degree, byte white_percent, byte pixcount_percent);
+
+  // Allocates a cache of 'max_frames' frames of output pixels, used to detect when a pattern
+  // has become periodic (the same sequence of frames repeating), or to hold the frames of the
+  // loop declared by the 'L' command. Once either happens the cached frames are played back
+  // with their original timing, without calling into any plugins, until the pattern changes
+  // in any way: triggering, a new command string, or any of the property settings. Patterns
+  // with automatic triggering are never cached. A loop is only detected once its frames have
+  // repeated twice, and never for patterns with effects whose frames don't repeat exactly
+  // (see PixelNutPlugin::repeats()), such as the waves and HueRotate, unless it's declared.
+  // Returns false if there's not enough memory. A value of 0 frees the cache, which is the
+  // default. (Not used in sync mode.)
+  bool setLoopCache(uint16_t max_frames);
+  bool getLoopPlaying() { return loopPlaying; }
+
+  // Sync mode, for running the same pattern in lockstep on several controllers, each with its
+  // own part of the display. The application must provide a clock that is shared by all of
+  // them: 'epoch_msecs' is the local getMsecs() value at the shared time 0, and 'seed' is a
+  // non-zero seed for the random values used by the engine and plugins. Call this with the
+  // same values on each controller before loading the same pattern. That pattern then starts
+  // at the epoch, nothing is drawn before it, and all timing is taken from the shared time,
+  // with the redraw and auto-trigger times of each layer advanced from their previous values
+  // instead of from when they were drawn, so that all controllers draw the same frames.
+  // Each call to updateEffects() steps through everything that has become due since the
+  // previous call in time order, so the epoch should be close to when the pattern is loaded.
+  // Disabling it returns to the local time and random() values.
+  void setSyncMode(bool enable, uint32_t epoch_msecs=0, uint32_t seed=1);
+  bool getSyncMode() { return syncMode; }
+
+  // Returns the current shared time in sync mode (0 before the epoch), else the local time.
+  uint32_t getSyncTime(void);
+
+  // Sets the tempo of the music that effects can be locked to, as 'bpm' beats per minute (0 to
+  // disable), with one of the beats at 'msecs' (in getMsecs() time, or the shared time in sync
+  // mode). Layers set with the 'R' command are then automatically triggered on the beats (or
+  // parts of them), with the 'O' and 'T' values counting those instead of seconds, and tracks
+  // set with the 'S' command redraw a number of times on each beat instead of after their
+  // delay. Can be called again at any time, such as on each beat detected in the music, to
+  // keep it in step; the next automatic triggers are then moved onto the new beats.
+  void setTempo(uint16_t bpm, uint32_t msecs=0);
+  uint16_t getTempo(void) { return beatsPerMin; }
+
+  // Records all of the calls that change what is drawn, and each call to updateEffects(),
+  // into 'pjournal', so that they can be replayed later with PixelNutJournal::replay() to
+  // reproduce exactly the same frames. Should be set before the first pattern is loaded.
+  // Since that needs the random values to be seeded, if they're not already (by sync mode),
+  // they are seeded with 'seed', and kept seeded even when sync mode is disabled. NULL
+  // stops recording (the default).
+  void setJournal(PixelNutJournal *pjournal, uint32_t seed=1);
+
+  // Same as triggerForce(force) below, but in sync mode the trigger is applied at the shared
+  // time 'msecs', so that all controllers it was sent to trigger on the same frame. Times that
+  // have already passed are applied on the next update. Returns false if there are already
+  // MAX_SYNC_TRIGGERS waiting. Not in sync mode this just calls triggerForce() immediately.
+  bool triggerForceAt(short force, uint32_t msecs);
+
   // Triggers effect layers with a range value of -MAX_FORCE_VALUE..MAX_FORCE_VALUE.
   // (Negative values are not utilized by most plugins: they take the absolute value.)
   // Must be enabled with the "I" command for each effect layer to be effected.
   void triggerForce(short force);
 
+  // Same as the above, but only for the effect layers in one logical segment.
+  void triggerSegForce(byte segindex, short force);
+
   // Used by plugins to trigger based on the effect layer, enabled by the "A" command.
-  void triggerForce(byte layer, short force);
+  void triggerForce(uint16_t layer, short force);
 
   // Called by the above and DoTrigger(), CheckAutoTrigger(), allows override
-  virtual void triggerLayer(byte layer, short force);
+  virtual void triggerLayer(uint16_t layer, short force);
 
   // Parses and executes a command string, returning a status code.
   // An empty string (or one with only spaces), is ignored.
+  // Loading a new pattern (a string with the 'P' command) is done as a whole: if it fails for
+  // any reason then everything it added is removed, and the previous pattern is left as it was.
+  // This means the previous pattern is kept until the new one is loaded, so to make all of the
+  // memory available for the new one (without being able to keep the old), call clearStack().
   virtual Status execCmdStr(char *cmdstr);
 
+  typedef struct // returned by checkCmdStr()
+  {
+    uint32_t bytes;     // number of bytes allocated for the effects, tracks and their buffers
+    uint32_t cost;      // estimated time to draw a frame in which every track is redrawn,
+                        // in units of about the time to set one pixel
+    uint16_t layers;    // number of effect layers
+    uint16_t tracks;    // number of tracks (drawing effects)
+  }
+  PatternCost;
+
+  // Checks a command string without executing it (or changing it), to find out what the pattern
+  // it creates would need before loading it. Returns an error status if any of its effects
+  // couldn't be created, else sets the memory and time needed into 'pcost'. Each effect must
+  // report any memory it allocates itself (see PixelNutPlugin::getcost()), and sparse tracks
+  // use more memory as pixels are lit. For a string without the 'P' command, this is only
+  // what would be added to the current pattern.
+  Status checkCmdStr(const char *cmdstr, PatternCost *pcost);
+
   // Pops off all layers from the stack
   virtual void clearStack(void);
 
   // Updates current effect: returns true if the pixels have changed and should be redisplayed.
   virtual bool updateEffects(void);
 
+  // Skips the current pattern ahead by 'msecs', as if that much time had passed, without
+  // drawing any of the frames in between: each effect is moved ahead by the number of steps
+  // it would have taken with a single call to the plugin's advance() method, which costs far
+  // less than taking the steps (for the waves, about as much as a few steps for each wave).
+  // The effects that add up a float value on each step add it exactly as those steps would
+  // have, so they end up with the same pixels. The new position is displayed on the next
+  // call to updateEffects(). Automatic triggers that would have happened are done once, at
+  // the start, and the steps are counted with the delay each track has at the start. Since
+  // each predraw effect is advanced before the drawing effect of its track, drawing effects
+  // that keep the pixels from earlier steps draw them all with the properties of the last
+  // step. So effects that are triggered, or change the delay or count along the way, are
+  // only approximated. Postdraw effects are not advanced. To show a pattern at some time
+  // from its start, load it and then seek to that time. Returns false (and does nothing)
+  // in sync mode.
+  bool seek(uint32_t msecs);
+
+  #if PIXELNUT_MEMSTATS
+  typedef struct // returned by getLayerMemory() and getEngineMemory()
+  {
+    uint32_t bytes;     // number of bytes currently allocated
+    uint32_t peak;      // most bytes that have been allocated at once
+  }
+  MemUsage;
+
+  // With PIXELNUT_MEMSTATS set to 1 (see PixelNutSupport.h), all memory allocated with
+  // pixelNutSupport.memAlloc() is charged to the effect layer it was allocated for: the plugin
+  // object itself, what it allocates (in begin() or later), and the pixel buffer of the track
+  // for drawing effects. Returns that for effect layer 'layer' (from 0 in the order they were
+  // added in the pattern), along with the number of its plugin, or false if there's no such
+  // layer. The peak is since the layer was created.
+  bool getLayerMemory(uint16_t layer, MemUsage *pusage, uint16_t *pplugin);
+
+  // Returns the memory used by the engine itself (the stacks and loop cache) and by everything
+  // together, with the peaks since it was created or resetMemPeaks() was called. After calling
+  // clearStack() the total is the same as the engine alone, unless some effect didn't free all
+  // of its memory.
+  void getEngineMemory(MemUsage *pengine, MemUsage *ptotal);
+  void resetMemPeaks(void);
+
+  // Private to the PixelNutSupport class: adds 'bytes' (which may be negative) to the memory
+  // used by effect layer 'layer' (MAX_WORD_VALUE for the engine itself).
+  void memCharge(uint16_t layer, int32_t bytes);
+  #endif
+
+  #if PIXELNUT_PROFILE
+  typedef void (*ProfileFunc)(byte region, uint16_t plugin, uint16_t pixels, bool start);
+
+  // With PIXELNUT_PROFILE set to 1 (see PixelNutSupport.h), 'func' is called with 'start' set
+  // just before each region of the engine's work (one of the PROFILE_ values), and again with
+  // it cleared just after, so that the application can measure them with whatever clock or
+  // counters it has. For PROFILE_STEP 'plugin' is the number of the effect stepped (that of
+  // the drawing effect for a fused kernel), and 'pixels' the length of its drawing window;
+  // for the others 'plugin' is 0 and 'pixels' the number of output pixels. Regions are never
+  // nested, and effects advanced by seek() are not included. NULL stops the calls (the default).
+  void setProfiler(ProfileFunc func) { profileFunc = func; }
+  #endif
+
   // Private to the PixelNutSupport class and main application.
   byte *pDrawPixels; // current pixel buffer to draw into or display
   // Note: test this for NULL after constructor to check if successful!
+  PixelNutSupport::SparsePixels *pDrawSparse = NULL; // used instead of above for sparse tracks
+  #if PIXELNUT_PLANAR
+  uint16_t drawPlaneLen = 0; // pixels in each plane of the above (0 if not in planes)
+  #endif
 
 protected:
 
+  PixelNutJournal *pJournal = NULL;             // records calls from the application if set
+  #if PIXELNUT_PROFILE
+  ProfileFunc profileFunc = NULL;               // called around each region of work if set
+  #endif
+
   byte pcentBright = MAX_PERCENTAGE;            // max percent brightness to apply to each effect
   int8_t delayOffset = 0;                       // additional delay to add to each effect (msecs)
                                                 // this is kept to be +/- 'DELAY_RANGE'
 
-  typedef struct ATTR_PACKED // 18-20 bytes
+  typedef struct ATTR_PACKED // 27-29 bytes (8 more with PIXELNUT_MEMSTATS)
   {
                                                 // auto triggering information:
     uint32_t trigTimeMsecs;                     // time of next trigger in msecs (0 if not set yet)
     int16_t trigCount;                          // number of times to trigger (-1 to repeat forever)
     uint16_t trigDelayMin;                      // min amount of delay before next trigger in seconds
     uint16_t trigDelayRange;                    // range of delay values possible (min...min+range)
+    byte trigBeatDivs;                          // if set the delays are in beats divided by this
 
                                                 // these apply to both auto and manual triggering:
     short trigForce;                            // amount of force to apply (-1 for random)
     bool trigActive;                            // true if this layer has been triggered at least once
     bool trigExtern;                            // true if external triggering is enabled for this layer
-    byte trigSource;                            // what other layer can trigger this layer (255 for none)
+    uint16_t trigSource;                        // what other layer can trigger this layer (MAX_WORD_VALUE for none)
+    uint16_t trigNext;                          // next layer with the same trigger source (MAX_WORD_VALUE for none)
+    uint16_t trigFirst;                         // first layer this layer triggers (MAX_WORD_VALUE for none)
 
-    byte track;                                 // index into properties stack for plugin
+    uint16_t track;                             // index into properties stack for plugin
     PixelNutPlugin *pPlugin;                    // pointer to the created plugin object
+    uint16_t plugin;                            // number of the plugin that was created
+
+    #if PIXELNUT_MEMSTATS
+    MemUsage memUsage;                          // memory charged to this layer
+    #endif
   }
   PluginLayer; // defines each layer of effect plugin
 
-  typedef struct ATTR_PACKED // 30-32 bytes
+  typedef struct ATTR_PACKED // 37-41 bytes
   {
     uint32_t msTimeRedraw;                      // time of next redraw of plugin in msecs
     byte *pRedrawBuff;                          // allocated buffer or NULL for postdraw effects
+                                                // (SparsePixels for sparse tracks)
+    PixelNutFusedStep fusedStep;                // steps the drawing effect with the predraw one
+                                                // in the next layer (NULL if not fused)
 
     PixelNutSupport::DrawProps draw;            // redraw properties for this plugin
 
-    byte layer;                                 // index into layer stack to redraw effect
+    uint16_t layer;                             // index into layer stack to redraw effect
     byte ctrlBits;                              // bits to control setting property values
 
     // used for logical segment control:
     byte segIndex;                              // assigned to this segment (from 0)
     byte disable;                               // non-zero to disable controls
+    bool sparse;                                // true if only lit pixels are stored
+    bool newColor;                              // true if must recalculate drawing color
+    byte maskCount;                             // tracks below this that it masks instead of being
+                                                // shown (0 if not a mask, MASK_ALL_TRACKS for all)
+    byte beatSteps;                             // redraws on each beat instead of after the delay
 
                                                 // for logical segments only:
     uint16_t segOffset;                         // output display buffer offset
@@ -144,16 +343,41 @@ protected:
   PluginTrack; // defines properties for each drawing plugin
 
   PluginLayer *pluginLayers;                    // plugin layers that creates effect
-  short maxPluginLayers;                        // max number of layers possible
+  short maxPluginLayers;                        // number of layers currently allocated
   short indexLayerStack  = -1;                  // index into the plugin layers stack
   short indexTrackEnable = -1;                  // higher indices are not yet activated
 
   PluginTrack *pluginTracks;                    // plugin tracks that have properties
-  short maxPluginTracks;                        // max number of tracks possible
+  short maxPluginTracks;                        // number of tracks currently allocated
   short indexTrackStack = -1;                   // index into the plugin properties stack
 
   uint32_t timePrevUpdate = 0;                  // time of previous call to update
 
+  bool syncMode = false;                        // true if in sync mode: timing is from shared time
+  uint32_t syncEpoch = 0;                       // local time of the shared time 0
+  uint32_t timeSync = 0;                        // shared time of current update or timed trigger
+  struct { uint32_t msecs; short force; } syncTrigs[MAX_SYNC_TRIGGERS]; // timed triggers by time
+  byte numSyncTrigs = 0;                        // number of timed triggers waiting
+
+  uint16_t beatsPerMin = 0;                     // tempo set by the application (0 if none)
+  uint32_t beatUsecs = 0;                       // usecs in each beat of that tempo
+  uint32_t beatMsecs = 0;                       // time of one of the beats
+
+  uint32_t *loopHashes = NULL;                  // hash of each cached frame (start of cache memory)
+  uint16_t *loopDelays;                         // msecs from previous frame for each cached frame
+  byte *loopFrames;                             // output pixels of each cached frame
+  uint16_t loopMaxFrames = 0;                   // number of frames in the cache (0 if disabled)
+  uint16_t loopCount = 0;                       // number of frames recorded so far (up to the max)
+  uint16_t loopIndex = 0;                       // where next frame is recorded, or played back from
+  uint16_t loopPeriod = 0;                      // number of frames in the loop (0 if none yet)
+  uint16_t loopMatches = 0;                     // number of frames found to repeat in that period
+  uint32_t loopTimeFrame = 0;                   // time of previous frame recorded or played
+  bool loopDeclared = false;                    // true if period was set with the 'L' command
+  bool loopPlaying = false;                     // true if playing back the cached frames
+
+  byte *pGroupPixels = NULL;                    // tracks that are masked as a group are merged into
+                                                // this first (allocated when a pattern needs it)
+
   bool goUpwards = true;                        // true to draw from start to end, else reverse
   short curForce = MAX_FORCE_VALUE/2;           // saves last settings to use on new patterns
   
@@ -163,21 +387,80 @@ protected:
   uint16_t segOffset;                           // offset in output buffer of current segment
   uint16_t segCount;                            // number of pixels to draw for current segment
 
+  uint16_t *segTracks;                          // track indices ordered by logical segment
+  uint16_t *segStarts = NULL;                   // index into above for each segment, plus the end
+  short numSegments = 0;                        // number of logical segments in the index
+  short maxSegments = 0;                        // number of segments allocated for 'segStarts'
+
   bool externPropMode = false;                  // true to allow external control of properties
   short externDegreeHue;                        // externally set values property values
   byte externPcentWhite;
   byte externPcentCount;
 
-  void SetPropColor(void);
-  void SetPropCount(void);
-  void RestorePropVals(PluginTrack *pTrack, uint16_t pixCount, uint16_t degreeHue, byte pcentWhite);
+  void SetPropVals(PluginTrack *pTrack, byte bits, short hue, byte white, byte count_percent);
+  void SetPropTracks(byte bits);
+  void SetPropSegment(byte segindex, byte bits, short hue, byte white, byte count_percent);
+  void UpdateColorVals(PluginTrack *pTrack);
+  void SetPropLocks(PluginTrack *pTrack);
 
-  Status NewPluginLayer(int plugin, int segnum);
+  bool trigIndexValid = false;                  // true if trigFirst/trigNext are up to date
+
+  #if PIXELNUT_MEMSTATS
+  MemUsage memEngine = {0,0};                   // memory charged to the engine itself
+  MemUsage memTotal  = {0,0};                   // memory charged to the engine and all layers
+  #endif
 
+  typedef struct // the stacks and everything else belonging to the current pattern
+  {
+    PluginLayer *pluginLayers;
+    PluginTrack *pluginTracks;
+    uint16_t *segTracks, *segStarts;
+    short maxPluginLayers, indexLayerStack, indexTrackEnable;
+    short maxPluginTracks, indexTrackStack;
+    short numSegments, maxSegments;
+    uint16_t segOffset, segCount;
+    uint16_t loopPeriod;
+    bool loopDeclared;
+  }
+  PatternStacks;
+
+  void ResizeSegment(uint16_t *poffset, uint16_t *pcount, uint16_t num_pixels);
+
+  void SwapStacks(PatternStacks *pstacks);
+  void FreeStacks(void);
+  void DeleteLayers(void);
+
+  bool GrowStacks(bool newtrack);
+  Status NewPluginLayer(int plugin, int segnum);
+  void MakeTrigIndex(void);
+  void MakeSegIndex(void);
+
+  void MergeBlock(uint16_t startpos, uint16_t endpos);
+  void MergeTrack(PluginTrack *pTrack, byte *pdisplay, bool mask, uint16_t startpos, uint16_t endpos);
+  void MergeSparseTrack(PluginTrack *pTrack, byte *pdisplay, uint16_t startpos, uint16_t endpos);
+  void MergeGroup(bool orvalues, uint16_t startpos, uint16_t endpos);
+
+  void LoopReset(void);
+  void LoopRecord(uint32_t time);
+  bool LoopPlay(uint32_t time);
+
+  void TriggerExtern(short force);
+  void JournalState(void);
+
+  uint32_t GetTime(void);
+  uint32_t NextEventTime(uint32_t time);
+  uint32_t BeatTime(uint32_t time, byte divs, uint32_t count);
+  uint32_t AutoTrigTime(PluginLayer *pLayer, uint32_t time);
+  bool UpdateAtTime(uint32_t time);
   void CheckAutoTrigger(bool rollover);
 };
 
 class PluginFactory
 {
   public: virtual PixelNutPlugin *makePlugin(int plugin);
+
+  // Returns the fused kernel for drawing effect number 'redrawPlugin' followed by predraw
+  // effect number 'predrawPlugin', or NULL if there isn't one. A derived class that makes
+  // different plugins for any of these numbers must override this to return NULL for them.
+  public: virtual PixelNutFusedStep makeFused(int redrawPlugin, int predrawPlugin);
 };
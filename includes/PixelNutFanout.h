@@ -0,0 +1,78 @@
+// PixelNut Fixture Fanout Class Definition
+// Used by applications to show the output pixels of one engine on many identical fixtures.
+/*
+    Copyright (c) 2015-2024, Greg de Valois
+    Software License Agreement (BSD License)
+    See license.txt for the terms of this license.
+*/
+
+#pragma once
+
+// The engine draws the pattern once for each frame, and each fixture is then given a copy
+// of its output pixels, made with the settings of an instance: the number of frames it is
+// behind the engine (taken from a ring of the most recent frames), whether the order of the
+// pixels is reversed, and a rotation of the hue and scaling of the brightness, which are
+// applied together as 3 coefficients (in 1/FANOUT_COEF_SCALE units) that mix the red, green,
+// and blue values of each pixel (a rotation around the axis of the gray values, which keeps
+// white values unchanged). The time taken by the engine doesn't change with the number of
+// fixtures, and fixtures that only have a delay can be shown directly from the ring.
+
+#define FANOUT_COEF_SCALE         256     // coefficients are in 1/256 units
+
+class PixelNutFanout
+{
+public:
+  typedef struct // settings for each fixture, made with makeInstance()
+  {
+    uint16_t delay;               // number of frames behind the engine
+    bool reverse;                 // true to reverse the order of the pixels
+    bool adjust;                  // false if the values are not changed
+    int16_t coefs[3];             // amount of the same, next, and previous color values
+    #if (PIXEL_CHANNELS == 4)
+    int16_t white;                // scaling of the white values
+    #endif
+  }
+  Instance;
+
+  // Constructor: 'num_pixels' is the number of pixels in the engine's output and in each
+  // fixture, 'pix_order' the order of the values in each pixel (the same as given to the
+  // PixelNutSupport constructor), and 'max_delay' the most frames that any fixture can be
+  // behind the engine. The ring holds (max_delay+1) frames, so with 0 no memory is allocated,
+  // and each frame is taken directly from the pixels passed to addFrame().
+  PixelNutFanout(uint16_t num_pixels, PixelValOrder *pix_order, uint16_t max_delay=0);
+  ~PixelNutFanout();
+
+  // Clears all of the frames in the ring, as if the engine had shown nothing until now.
+  void reset(void);
+
+  // Sets the settings of 'pinst' for a fixture that is 'delay' frames behind the engine,
+  // with the pixels in reverse order if 'reverse' is true, and the hue rotated by 'hue_degree'
+  // (-MAX_DEGREES_HUE..MAX_DEGREES_HUE) and the brightness scaled by 'bright_percent'.
+  // Returns false (leaving 'pinst' unchanged) if 'delay' is more than max_delay.
+  bool makeInstance(Instance *pinst, uint16_t delay=0, bool reverse=false,
+                    short hue_degree=0, byte bright_percent=MAX_PERCENTAGE);
+
+  // Adds the engine's output pixels as the most recent frame. Must be called for each frame
+  // that is shown, whether or not updateEffects() returned true, so that the delays are in
+  // frames shown. Without a ring 'pframe' must not change until after the fixtures are shown.
+  void addFrame(const byte *pframe);
+
+  // Returns the frame from 'delay' frames ago (which must not be more than max_delay),
+  // to be shown directly on fixtures that are only delayed (or NULL before addFrame()).
+  const byte *getFrame(uint16_t delay=0);
+
+  // Makes the pixels for the fixture with the settings 'pinst' in 'pout', which has
+  // num_pixels*PIXEL_CHANNELS bytes. Does nothing before addFrame() is called.
+  void makeFrame(const Instance *pinst, byte *pout);
+
+  // Note: test this for NULL after constructing with 'max_delay' to check if successful!
+  byte *pFrames = NULL;           // ring of the most recent frames
+
+protected:
+
+  PixelValOrder *pPixOrder;       // order of the values in each pixel
+  uint16_t numPixels;             // number of pixels in each frame
+  uint32_t numFrames;             // number of frames in the ring (0 if none), max_delay+1
+  uint16_t newestFrame = 0;       // index of the most recent frame in the ring
+  const byte *pNewest = NULL;     // most recent frame
+};
@@ -0,0 +1,116 @@
+// PixelNut Input Journal Class Definition
+// Used by applications to record the calls made into the engine, and to replay them.
+/*
+    Copyright (c) 2015-2024, Greg de Valois
+    Software License Agreement (BSD License)
+    See license.txt for the terms of this license.
+*/
+
+#pragma once
+
+// Each call into the engine that changes what it draws is recorded with the time it was
+// made, as a record whose first byte is either an update (with the high bit set, and the
+// msecs since the previous record in the lower 7 bits), or one of the types below, which is
+// followed by the msecs since the previous record, and then the values passed in the call.
+// These are all variable length values (7 bits per byte, lowest first), with the signed
+// values zigzag encoded (so small negative values are small too). Checkpoints have the
+// full time instead, and commands the length of the string followed by its characters.
+//
+// A checkpoint is recorded before each pattern is loaded or cleared, with the settings of
+// the engine, in this order: the state of the random values, sync mode, epoch and time,
+// frames in the loop cache, max brightness, delay offset, property mode, the externally
+// set hue, white and count properties, the trigger force, and the number of timed triggers
+// waiting in sync mode, followed by MAX_SYNC_TRIGGERS pairs of their time and force
+// (unused ones are 0), the tempo and the time of one of its beats, and lastly the number
+// of pixels. If the pattern then fails to load, the previous pattern is kept, and so the
+// checkpoint is changed to JOURNAL_FAILED, which cannot be replayed from.
+
+#define JOURNAL_CHECKPOINT        0   // engine settings before a pattern is loaded or cleared
+#define JOURNAL_UPDATE            1   // updateEffects() (if too long since the previous record)
+#define JOURNAL_COMMAND           2   // execCmdStr()
+#define JOURNAL_CLEAR             3   // clearStack()
+#define JOURNAL_FORCE             4   // triggerForce()
+#define JOURNAL_SEGFORCE          5   // triggerSegForce()
+#define JOURNAL_FORCEAT           6   // triggerForceAt()
+#define JOURNAL_COLOR             7   // setColorProperty()
+#define JOURNAL_COUNT             8   // setCountProperty()
+#define JOURNAL_PROPS             9   // setProperties()
+#define JOURNAL_SEGCOLOR          10  // setSegColorProperty()
+#define JOURNAL_SEGCOUNT          11  // setSegCountProperty()
+#define JOURNAL_SEGPROPS          12  // setSegProperties()
+#define JOURNAL_PROPMODE          13  // setPropertyMode()
+#define JOURNAL_BRIGHT            14  // setMaxBrightness()
+#define JOURNAL_DELAY             15  // setDelayOffset()
+#define JOURNAL_LOOPCACHE         16  // setLoopCache()
+#define JOURNAL_SYNCMODE          17  // setSyncMode()
+#define JOURNAL_SEEK              18  // seek()
+#define JOURNAL_FAILED            19  // checkpoint before a pattern that failed to load
+#define JOURNAL_RESIZE            20  // resize()
+#define JOURNAL_TEMPO             21  // setTempo()
+#define JOURNAL_NUM_TYPES         22
+
+#define JOURNAL_STATE_VALUES      (16 + (2 * MAX_SYNC_TRIGGERS)) // number of values in a checkpoint
+
+class PixelNutEngine;
+
+class PixelNutJournal
+{
+public:
+  // Constructor: 'max_bytes' is the size of the buffer that holds the most recent records,
+  // with the oldest ones discarded to make room for each new one. Most records are only a
+  // few bytes, and each update is a single byte, so with 50 updates a second and occasional
+  // other calls, 4K bytes holds over a minute. Enabled with PixelNutEngine::setJournal().
+  PixelNutJournal(uint32_t max_bytes);
+  ~PixelNutJournal();
+
+  // Discards all of the records.
+  void reset(void);
+
+  // Returns the number of bytes currently recorded.
+  uint32_t getLength(void) { return numBytes; }
+
+  // Copies the records into 'pout', which has 'maxlen' bytes, oldest first, returning the
+  // number of bytes copied, or 0 if that isn't enough room for all of them.
+  uint32_t readRecords(byte *pout, uint32_t maxlen);
+
+  // Replays the records from readRecords() ('pdata' with 'len' bytes) into 'pengine', which
+  // must be newly constructed with the same number of pixels (and the same plugins) as the
+  // engine they were recorded from. This starts from the first checkpoint, so the records
+  // must go back to when the first pattern was loaded that is to be replayed, and stops at
+  // a call to resize(), since the pixels are then in a buffer that belongs to the application.
+  // The time is taken from the records instead of the getMsecs() call, and 'frame_func' is
+  // called after each call to updateEffects() with that time, and whether the pixels changed,
+  // so that the frames can be examined or profiled. Since the random values are seeded, and
+  // restored from the checkpoint, these are the same frames the engine drew when it was
+  // recorded (as long as none of the patterns failed to load for lack of memory). Returns the
+  // number of updates, or 0 if there's no checkpoint, the records are not valid, or the
+  // number of pixels differs.
+  static uint32_t replay(const byte *pdata, uint32_t len, PixelNutEngine *pengine,
+                         void (*frame_func)(uint32_t msecs, bool changed));
+
+  // Private to the PixelNutEngine class: appends a record of 'type' with its values. These
+  // return false if there's no buffer, or the record can never fit in it, which also discards
+  // the records already there, since they can't be replayed without it.
+  bool record(byte type, int32_t val1=0, int32_t val2=0, int32_t val3=0, int32_t val4=0);
+  bool recordCommand(const char *cmdstr);
+  bool recordState(const int32_t *pvals); // JOURNAL_STATE_VALUES values
+  void failedState(void); // the most recent checkpoint cannot be replayed from
+
+  // Note: test this for NULL after constructing to check if successful!
+  byte *pRecords = NULL;          // circular buffer of records
+
+protected:
+
+  uint32_t maxBytes;              // size of the buffer
+  uint32_t firstByte = 0;         // index of the oldest record
+  uint32_t numBytes = 0;          // number of bytes recorded
+  uint32_t timePrevRecord = 0;    // time of the most recent record
+  uint32_t stateByte;             // index of the most recent checkpoint
+  bool haveState = false;         // false if that has been discarded
+
+  static void SetState(PixelNutEngine *pengine, const int32_t *pvals);
+
+  uint32_t RecordLength(uint32_t index);
+  void MakeRoom(uint32_t count);
+  void PutByte(byte value);
+};
@@ -13,10 +13,14 @@
 // (although to do anything interesting one of other functions needs to be overriden too).
 
                                         // these are mutually exclusive:
-#define PLUGIN_TYPE_REDRAW        0x01  // creates pixel values from settings, else
-                                        // alters those effect settings before drawing
+#define PLUGIN_TYPE_REDRAW        0x01  // creates pixel values from settings
+#define PLUGIN_TYPE_POSTDRAW      0x02  // alters the output pixels after all tracks are merged
+                                        // (if neither is set then the plugin is a predraw type,
+                                        // which alters the effect settings before drawing)
 
                                         // any combination of these is valid:
+#define PLUGIN_TYPE_SPARSE        0x04  // only draws a few pixels at a time, so only the lit
+                                        // pixels are stored for the track instead of all of them
 #define PLUGIN_TYPE_DIRECTION     0x08  // changing direction changes effect
 #define PLUGIN_TYPE_TRIGGER       0x10  // triggering changes the effect
 #define PLUGIN_TYPE_USEFORCE      0x20  // trigger force is used in effect
@@ -28,14 +32,34 @@ class PixelNutPlugin
 public:
   virtual ~PixelNutPlugin() = 0; // an empty default method is provided
 
+  // Plugins are created with this, which keeps the size of the most recently created one,
+  // so that the memory used by each effect is known without it having to report it. The
+  // memory is cleared, so a plugin that is deleted without begin() having been called sees
+  // all of its values as 0 (NULL) in its destructor.
+  static void *operator new(size_t size) noexcept
+  {
+    newSize = size;
+    void *ptr = pixelNutSupport.memAlloc(size);
+    if (ptr != NULL) memset(ptr, 0, size);
+    return ptr;
+  }
+  static void operator delete(void *ptr) { pixelNutSupport.memFree(ptr); }
+  static uint16_t newSize;
+
   // Returns capability bits indicating how this plugin affects pixel values.
   // This is the only required method that must be implemented in each plugin.
   virtual byte gettype(void) const = 0; // one or more PLUGIN_TYPE_ values
 
   // Start this effect, given the number of pixels in the strip to be drawn.
   // If any memory is allocated here make sure it's freed in the class destructor.
+  // Allocate it with pixelNutSupport.memAlloc() so that it's charged to this effect layer.
   // The "id" value identifies this layer, and is used to trigger other plugins.
-  virtual void begin(byte id, uint16_t pixlen) {}
+  virtual void begin(uint16_t id, uint16_t pixlen) {}
+
+  // Called when the number of pixels of the strip this effect draws is changed to 'pixlen',
+  // after which it's triggered again if it had been. By default this just calls begin() again,
+  // so plugins that allocate memory in begin() must override this to free (or reallocate) it.
+  virtual void resize(uint16_t id, uint16_t pixlen) { begin(id, pixlen); }
 
   // Trigger a change to the effect with an amount of "force" to be applied.
   // Guaranteed to be called here first before any calls to nextstep().
@@ -44,4 +68,35 @@ public:
   // Perform the next step of an effect by this plugin using the current drawing
   // properties. The rate at which this is called depends on the delay property.
   virtual void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw) {}
+
+  // Returns an estimate of what this effect needs to draw 'pixlen' pixels, used to check a
+  // pattern before loading it: the number of bytes allocated by begin() is set into 'pbytes'
+  // (so this must be overridden by plugins that allocate memory), and the value returned is
+  // the time taken by each call to nextstep(), in units of about the time to set one pixel.
+  // By default nothing is allocated, and effects that alter pixels take one unit per pixel,
+  // while those that only change the drawing properties take a single unit.
+  virtual uint16_t getcost(uint16_t pixlen, uint32_t *pbytes)
+  {
+    *pbytes = 0;
+    return ((gettype() & (PLUGIN_TYPE_REDRAW | PLUGIN_TYPE_POSTDRAW)) ? pixlen : 1);
+  }
+
+  // Perform the next 'steps' steps at once, as when seeking ahead in a pattern, leaving the
+  // effect (and any pixels it draws) as if nextstep() had been called that many times.
+  // Plugins whose state after a number of steps can be directly calculated should override
+  // this to skip to the last step; the default just calls nextstep() repeatedly.
+  virtual void advance(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, uint32_t steps)
+    { while (steps--) nextstep(handle, pdraw); }
+
+  // Returns false if the engine shouldn't look for the frames of a pattern with this effect to
+  // repeat, so that they're played back from the loop cache (see setLoopCache()). Plugins that
+  // add up a float value on each step must override this, since the frames can look the same
+  // while that value drifts, or stay the same for many steps while it changes slowly.
+  virtual bool repeats(void) { return true; }
 };
+
+// Steps a drawing effect and the predraw effect that follows it on its track together, as
+// nextstep() on each of them would, so that both are done in a single call for each step
+// (returned by PluginFactory::makeFused() for combinations of effects that it recognizes).
+typedef void (*PixelNutFusedStep)(PixelNutHandle handle, PixelNutPlugin *pPredraw,
+                                  PixelNutPlugin *pRedraw, PixelNutSupport::DrawProps *pdraw);
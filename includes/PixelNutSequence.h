@@ -0,0 +1,53 @@
+// PixelNut Sequence Plugin Base Class
+// Allows a plugin to write its effect as a sequential loop instead of a state machine.
+/*
+    Copyright (c) 2015-2024, Greg de Valois
+    Software License Agreement (BSD License)
+    See license.txt for the terms of this license.
+*/
+
+#pragma once
+
+// A plugin derived from this class implements nextstep() as a sequence of steps, between
+// SEQ_BEGIN() and SEQ_END(), with SEQ_YIELD() wherever each step is complete. For example:
+//
+//   void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
+//   {
+//     SEQ_BEGIN();
+//     for (pos = 0; pos < pixLength; ++pos)  // forward...
+//     {
+//       pixelNutSupport.setPixel(handle, pos, pdraw->r, pdraw->g, pdraw->b);
+//       SEQ_YIELD();
+//     }
+//     for (; pos > 0; --pos)                 // ...and back again
+//     {
+//       pixelNutSupport.setPixel(handle, pos-1, 0,0,0);
+//       SEQ_YIELD();
+//     }
+//     SEQ_END();
+//   }
+//
+// Each call to nextstep() continues just after the SEQ_YIELD() that ended the previous step,
+// and once SEQ_END() is reached the next call starts over from the beginning. This is done by
+// switching on the line number of that SEQ_YIELD(), so all that is kept between steps is that
+// number: there is no saved stack frame and nothing is allocated, and the cost is the same as
+// a plain nextstep() plus one switch. Because of this:
+//
+//  1) Any values used across a SEQ_YIELD() must be class members, not local variables
+//     (which also can't be declared with initializers in the same block as a SEQ_YIELD()).
+//  2) SEQ_YIELD() can only be used directly in nextstep(), not inside a switch statement,
+//     and only once per line.
+//
+// Calling seqRestart() (from begin() or trigger(), for instance) starts it over on the next step.
+
+#define SEQ_BEGIN()   switch (seqPoint) { case 0:
+#define SEQ_YIELD()   do { seqPoint = __LINE__; return; case __LINE__:; } while (0)
+#define SEQ_END()     } seqPoint = 0
+
+class PixelNutSequence : public PixelNutPlugin
+{
+protected:
+  void seqRestart(void) { seqPoint = 0; }
+
+  uint16_t seqPoint = 0;        // line of the SEQ_YIELD() to continue from (0 for the start)
+};
@@ -26,19 +26,65 @@
 #define MAX_WORD_VALUE            65535   // max value in 16 bits (unsigned)
 #define MAX_PERCENTAGE            100     // max percent value (0..100)
 #define MAX_DEGREES_HUE           359     // hue value is 0-359
-#define MAX_TRACK_LAYER           254     // max value for track/layer
+#define MAX_TRACK_LAYER           32000   // max value for track/layer
 #define MAX_PIXEL_VALUE           255     // max value for pixel
 #define MAX_DELAY_VALUE           255     // max value for delay
 #define MAX_FORCE_VALUE           1000    // max value for force
 #define MAX_PLUGIN_VALUE          32000   // max value for plugin
+#define MAX_BLUR_RADIUS           8       // max pixel radius for blurPixels()
+#define HUE_STEP_SCALE            256     // hue values for setPixelsHue() are in 1/256 degrees
+#define MAX_SYNC_TRIGGERS         8       // max timed triggers pending in sync mode
+#define MIN_LOOP_MATCHES          64      // min frames found to repeat before playing a loop
+
+// number of bytes per pixel: 3 for RGB pixels (WS2812B, APA102), or 4 for RGBW pixels (SK6812),
+// which must be defined the same way when compiling both the library and the application
+#ifndef PIXEL_CHANNELS
+#define PIXEL_CHANNELS            3
+#endif
+#if (PIXEL_CHANNELS != 3) && (PIXEL_CHANNELS != 4)
+#error "PIXEL_CHANNELS must be 3 (RGB) or 4 (RGBW)"
+#endif
+
+// set to 1 to account for the memory used by each effect layer (see PixelNutEngine::getLayerMemory()),
+// which adds 8 bytes to each allocation, and must be defined the same way when compiling both
+// the library and the application
+#ifndef PIXELNUT_MEMSTATS
+#define PIXELNUT_MEMSTATS         0
+#endif
+
+// set to 1 to store the pixels of each track as separate planes of values (all of the first
+// values of each pixel, then all of the second, and so on, in the same order as the output
+// pixels), instead of the values of each pixel together, so that the routines that operate
+// on a range of pixels work on runs of single bytes, which compilers can vectorize, and the
+// values are only put together once, when the tracks are merged into the output pixels
+#ifndef PIXELNUT_PLANAR
+#define PIXELNUT_PLANAR           0
+#endif
+
+// number of output pixels that all of the tracks are merged into at a time, so that on processors
+// with a data cache, long strips are only read and written once for each frame instead of once
+// for each track (about 1K pixels of a few tracks fits into a 32K L1 cache), or 0 for all of them
+// (shorter strips are always merged all at once)
+#ifndef PIXELNUT_MERGE_BLOCK
+#define PIXELNUT_MERGE_BLOCK      1024
+#endif
+
+// set to 1 to have the engine call a function at the start and end of each part of its work
+// (see PixelNutEngine::setProfiler()), so that it can be measured with hardware counters
+#ifndef PIXELNUT_PROFILE
+#define PIXELNUT_PROFILE          0
+#endif
 
 typedef void* PixelNutHandle;   // context to call methods with
 
 typedef uint32_t (*GetMsecsTime)(void);
 
-typedef struct // defines ordering of RGB pixel values
+typedef struct // defines ordering of RGB(W) pixel values
 {
   byte r,g,b;
+  #if (PIXEL_CHANNELS == 4)
+  byte w;
+  #endif
 }
 PixelValOrder;
 
@@ -48,6 +94,8 @@ public:
   // 'pix_array' is array of 3 bytes: index of Red, Green, Blue pixels
   // WS2812B pixels are ordered GRB: array = [1,0,2]
   // APA102 pixels are ordered BGR, array [2,1,0]
+  // With PIXEL_CHANNELS set to 4 there is a 4th byte for the index of White:
+  // SK6812 RGBW pixels are ordered GRBW: array = [1,0,2,3]
   PixelNutSupport(GetMsecsTime get_msecs, PixelValOrder *pix_order); // constructor
 
   /////////////////////////////////////////////////////////////////////////////
@@ -69,7 +117,7 @@ public:
   // and the Plugins to draw into pixel buffers and handle trigger events.
 
   // properties that can be modified at any time by commands/plugins:
-  typedef struct ATTR_PACKED // 16 bytes
+  typedef struct ATTR_PACKED // 17 bytes
   {
       uint16_t pixStart, pixLen;  // start/length of range of pixels to be drawn (0...)
       uint16_t pixCount;          // pixel count property, not related to above extent
@@ -78,29 +126,110 @@ public:
       byte pcentWhite;            // percent whiteness (0-MAX_PERCENTAGE)
       byte pcentBright;           // percent brightness (0-MAX_PERCENTAGE)
       byte r,g,b;                 // RGB calculated from the above 3 values
+                                  // (for RGBW pixels the white is extracted when drawn)
 
       byte msecsDelay;            // determines msecs delay after each redraw
 
       bool goUpwards;             // direction of drawing (pixel index)
       bool orPixelValues;         // whether pixels overwrites or are OR'ed
+
+      byte extLocks;              // ExtControlBit bits of properties that plugins cannot change
   }
   DrawProps; // defines properties used in drawing an effect
 
   void makeColorVals(DrawProps *pdraw); // performs translation of hue/white/bright to RGB pixel values
 
-  // abstracts plugins from the direct handling of the pixel values:
+  // Used by plugins to change the properties that can be externally controlled, instead of
+  // setting them directly, so that the engine's external property mode is honored. Returns
+  // false if the property is currently locked, and so was not changed.
+  bool setPropHue(  DrawProps *pdraw, uint16_t degrees);  // sets degreeHue
+  bool setPropWhite(DrawProps *pdraw, byte percent);      // sets pcentWhite
+  bool setPropCount(DrawProps *pdraw, uint16_t count);    // sets pixCount
+
+  // used to store only the lit pixels for tracks with the PLUGIN_TYPE_SPARSE plugin type:
+  typedef struct ATTR_PACKED // 5-6 bytes
+  {
+      uint16_t pos;               // index of pixel in the track
+      byte vals[PIXEL_CHANNELS];  // pixel values, in the same order as the output pixels
+  }
+  SparsePixel; // defines each lit pixel of a sparse track
+
+  typedef struct // only the pixels in the list are lit, all others are off
+  {
+      uint16_t count;             // number of pixels that are currently lit
+      uint16_t maxcount;          // number of entries allocated in the list
+      SparsePixel *pixels;        // list of lit pixels in order of position, grows as needed
+  }
+  SparsePixels; // defines the pixels for a sparse track
+
+  // abstracts plugins from the direct handling of the pixel values, which are in separate planes
+  // with PIXELNUT_PLANAR set for the pixels of tracks (but not the merged output pixels)
+  // (these also handle sparse tracks, unlike the span routines below):
   void movePixels( PixelNutHandle p, uint16_t startpos, uint16_t endpos, uint16_t newpos);    // moves range of pixels
   void clearPixels(PixelNutHandle p, uint16_t startpos, uint16_t endpos);                     // clears range of pixels
+  // (for RGBW pixels, setPixel() moves the white common to all 3 values into the W channel,
+  //  and getPixel() adds it back, so plugins always work with RGB values)
   void getPixel(   PixelNutHandle p, uint16_t pos, byte *ptr_r, byte *ptr_g, byte *ptr_b);    // gets RGB pixel values
   void setPixel(   PixelNutHandle p, uint16_t pos, byte r, byte g, byte b, float scale=1.0);  // sets RGB pixel values
   void setPixel(   PixelNutHandle p, uint16_t pos, float scale); // scales existing value without applying gamma correction
 
+  // sets a range of pixels from separate hue (0-MAX_DEGREES_HUE), saturation (0-MAX_PERCENTAGE)
+  // and value (0-MAX_BYTE_VALUE) arrays, or from a starting hue and the amount added to it for
+  // each pixel (both in 1/HUE_STEP_SCALE degrees), using only integer math (gamma is applied)
+  // (these cannot be used on sparse tracks)
+  void setPixelsHSV(PixelNutHandle p, uint16_t startpos, uint16_t endpos,
+                    const uint16_t *phues, const byte *psats, const byte *pvals);
+  void setPixelsHue(PixelNutHandle p, uint16_t startpos, uint16_t endpos,
+                    uint32_t hue, int32_t step, byte sat, byte val);
+
+  // sets a range of pixels to the same RGB values, exactly as setPixel() sets each of them with
+  // a 'scale' that scaleBright() returns 'bright' for, but only making the values once, so that
+  // runs of pixels with the same brightness can be drawn at once (cannot be used on sparse tracks)
+  byte scaleBright(PixelNutHandle p, float scale); // brightness setPixel() uses (0-MAX_BYTE_VALUE)
+  void fillPixels(PixelNutHandle p, uint16_t startpos, uint16_t endpos, byte r, byte g, byte b, byte bright);
+
+  // span routines that operate on all of the pixel values in a range at once,
+  // used mostly by the postdraw plugins on the merged output pixels
+  // (except for scalePixels() these cannot be used on sparse tracks):
+  void scalePixels(  PixelNutHandle p, uint16_t startpos, uint16_t endpos, byte scale);                   // scales by scale/256
+  void blurPixels(   PixelNutHandle p, uint16_t startpos, uint16_t endpos, byte radius);                  // box blur over 2*radius+1
+  void mirrorPixels( PixelNutHandle p, uint16_t startpos, uint16_t endpos, uint16_t newpos);              // copies range reversed
+  void persistPixels(PixelNutHandle p, uint16_t startpos, uint16_t endpos, byte *phistory, byte decay);   // merges decaying history
+
+  // random number generator used by the engine and plugins: returns min...max-1 the same
+  // as the Arduino random() call, unless seeded with a non-zero value, which then always
+  // produces the same sequence of values (used by the sync mode of the engine)
+  long randomValue(long min, long max);
+  void setRandomSeed(uint32_t seed); // 0 returns to using random()
+  uint32_t getRandomSeed(void);      // current state (0 if not seeded), to continue from later
+
   // utility functions to map and clip values into/over a range of values
   long mapValue(long inval, long in_min, long in_max, long out_min, long out_max);
   long clipValue(long inval, long out_min, long out_max);
 
+  // adds 'step' to '*pvalue' up to 'count' times, with exactly the same float result as adding
+  // it one at a time (as plugins do on each step), but stops before a sum that would be less
+  // than 'minval' or more than 'maxval': returns the number of times it was added, which is
+  // all of them if the step is too small to change the value
+  uint32_t addFloatSteps(float *pvalue, float step, uint32_t count, double minval, double maxval);
+
   // sends trigger force to any other effect that has been assigned to this 'id'
-  void sendForce(PixelNutHandle p, byte id, short force);
+  void sendForce(PixelNutHandle p, uint16_t id, short force);
+
+  // used by the engine and plugins to allocate memory, so that with PIXELNUT_MEMSTATS set it's
+  // charged to the effect layer it was allocated for (memory from these must be freed with memFree()):
+  #if PIXELNUT_MEMSTATS
+  void *memAlloc(size_t size);
+  void *memRealloc(void *ptr, size_t size);
+  void memFree(void *ptr);
+
+  PixelNutHandle memHandle = NULL;  // set by the engine to the engine and layer that
+  uint16_t memLayer;                // allocations are charged to (NULL if not charged)
+  #else
+  void *memAlloc(size_t size)               { return malloc(size); }
+  void *memRealloc(void *ptr, size_t size)  { return realloc(ptr, size); }
+  void memFree(void *ptr)                   { free(ptr); }
+  #endif
 };
 
 extern PixelNutSupport pixelNutSupport; // single statically allocated instance
@@ -31,7 +31,7 @@ public:
     return PLUGIN_TYPE_REDRAW;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     pixLength = pixlen;
   }
@@ -43,14 +43,14 @@ public:
     // turn some off
     for (uint16_t i = 0; i < pdraw->pixCount; ++i)
     {
-      uint16_t pos = random(0, pixLength);
+      uint16_t pos = pixelNutSupport.randomValue(0, pixLength);
       pixelNutSupport.setPixel(handle, pos, 0,0,0);
     }
 
     // turn some back on
     for (uint16_t i = 0; i < pdraw->pixCount; ++i)
     {
-      uint16_t pos = random(0, pixLength);
+      uint16_t pos = pixelNutSupport.randomValue(0, pixLength);
       pixelNutSupport.setPixel(handle, pos, pdraw->r, pdraw->g, pdraw->b);
     }
   }
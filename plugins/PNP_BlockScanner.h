@@ -30,7 +30,7 @@ public:
     return PLUGIN_TYPE_REDRAW | PLUGIN_TYPE_SENDFORCE;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     pixLength = pixlen;
     myid = id;
@@ -105,7 +105,7 @@ public:
   }
 
 private:
-  byte myid;
+  uint16_t myid;
   short forceVal;
   bool goForward;
   int16_t pixLength, lastCount, headPos;
@@ -43,7 +43,7 @@ public:
     return PLUGIN_TYPE_TRIGGER | PLUGIN_TYPE_USEFORCE;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     minBright = -1;
   }
@@ -28,6 +28,12 @@
 //    value to determine the modulation with a cosine function. The very first time
 //    this is called the median brightness is set to the current property value.
 //
+// Calling advance():
+//
+//    Adds up the angle for each step exactly as nextstep() does, but many steps at once
+//    except where a wave is completed, sending the force once if any were completed along
+//    the way, then sets the property for that step.
+//
 // Properties Used:
 //
 //    pcentBright - read to set the median brightness the very first call to nextstep().
@@ -46,7 +52,7 @@ public:
            PLUGIN_TYPE_TRIGGER | PLUGIN_TYPE_USEFORCE  | PLUGIN_TYPE_SENDFORCE;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     myid = id;
     baseValue = 0;   // will be set on first call to nextstep()
@@ -71,19 +77,44 @@ public:
 
     //pixelNutSupport.msgFormat(F("BrightWave: force=%d bright=%d angle(*100)=%d"), forceVal, pdraw->pcentBright, (int)(angleNext*100));
 
-    angleNext += (RADIANS_PER_WAVE / 100.0) * ((float)forceVal / MAX_FORCE_VALUE);
+    if (AddAngle()) pixelNutSupport.sendForce(handle, myid, forceVal);
+  }
+
+  bool repeats(void) { return false; } // adds up a float angle on each step
+
+  void advance(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, uint32_t steps)
+  {
+    if (!steps) return;
 
-    if (angleNext > RADIANS_PER_WAVE)
+    // the angle is added up for all but the last step, one step at a time only where
+    // it starts over, so that it's exactly what it would have been
+    uint32_t count = (steps-1);
+    bool wrapped = false;
+    while ((count -= pixelNutSupport.addFloatSteps(&angleNext, AngleStep(), count, 0, RADIANS_PER_WAVE)) > 0)
     {
-      angleNext -= RADIANS_PER_WAVE;
-      pixelNutSupport.sendForce(handle, myid, forceVal);
+      AddAngle(); // starts over at the start of the wave
+      wrapped = true;
+      --count;
     }
-    else if (angleNext < 0)
-      angleNext += RADIANS_PER_WAVE;
+    if (wrapped) pixelNutSupport.sendForce(handle, myid, forceVal);
+
+    nextstep(handle, pdraw);
   }
 
 private:
-  byte myid;
+  // adds the angle for a step (which is never negative), starting over if it goes past
+  // the end of the wave, and returns true if it did
+  bool AddAngle(void)
+  {
+    angleNext += AngleStep();
+    if (angleNext <= RADIANS_PER_WAVE) return false;
+    angleNext -= RADIANS_PER_WAVE;
+    return true;
+  }
+
+  float AngleStep(void) { return (RADIANS_PER_WAVE / 100.0) * ((float)forceVal / MAX_FORCE_VALUE); }
+
+  uint16_t myid;
   short forceVal;
   uint16_t baseValue;
   float angleNext;
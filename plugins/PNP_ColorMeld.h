@@ -29,7 +29,7 @@ public:
     return PLUGIN_TYPE_TRIGGER | PLUGIN_TYPE_NEGFORCE | PLUGIN_TYPE_SENDFORCE;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     myid = id;
     endHue = endWhite = -2; // forces initialization
@@ -90,6 +90,8 @@ public:
 
     //pixelNutSupport.msgFormat(F("ColorStep: hue=%d=>%d, white=%d=>%d"), curHue, endHue, curWhite, endWhite);
 
+    // set directly, not with setProp..(), as only the drawing color is changed:
+    // these are put back below, which also allows melding into external colors
     pdraw->degreeHue = curHue;
     pdraw->pcentWhite = curWhite;
     pixelNutSupport.makeColorVals(pdraw);
@@ -100,7 +102,7 @@ public:
   }
 
 private:
-  byte myid;
+  uint16_t myid;
   short forceVal;
   int16_t curHue, curWhite;
   int16_t endHue, endWhite;
@@ -40,17 +40,16 @@ public:
  
     uint16_t addhue = (uint16_t)(pcentforce * MAX_DEGREES_HUE/10);
     if (!addhue) addhue = 1;
-    pdraw->degreeHue += addhue;
-    pdraw->degreeHue %= (MAX_DEGREES_HUE+1);
+    bool doset = pixelNutSupport.setPropHue(pdraw, ((pdraw->degreeHue + addhue) % (MAX_DEGREES_HUE+1)));
 
     uint16_t addwhite = (uint16_t)(pcentforce * MAX_PERCENTAGE/10);
     if (!addwhite) addwhite = 1;
-    pdraw->pcentWhite += addwhite;
-    pdraw->pcentWhite %= 30; // keep under 30% white
+    if (pixelNutSupport.setPropWhite(pdraw, ((pdraw->pcentWhite + addwhite) % 30))) // keep under 30% white
+      doset = true;
 
     //pixelNutSupport.msgFormat(F("ColorModify2: force=%d%% hue=%d white=%d"),
     //    (int)(pcentforce*100), pdraw->degreeHue, pdraw->pcentWhite);
  
-    pixelNutSupport.makeColorVals(pdraw);
+    if (doset) pixelNutSupport.makeColorVals(pdraw);
   }
 };
@@ -31,9 +31,11 @@ public:
 
   void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
   {
-    pdraw->degreeHue  = random(0, MAX_DEGREES_HUE+1);
-    pdraw->pcentWhite = random(0, 60); // keep under 60% white
-    pixelNutSupport.makeColorVals(pdraw);
+    bool doset = pixelNutSupport.setPropHue(pdraw, pixelNutSupport.randomValue(0, MAX_DEGREES_HUE+1));
+    if (pixelNutSupport.setPropWhite(pdraw, pixelNutSupport.randomValue(0, 60))) // keep under 60% white
+      doset = true;
+
+    if (doset) pixelNutSupport.makeColorVals(pdraw);
 
     //pixelNutSupport.msgFormat(F("ColorRandom: hue=%d white=%d"), pdraw->degreeHue, pdraw->pcentWhite);
   }
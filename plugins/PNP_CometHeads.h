@@ -49,20 +49,17 @@ public:
 
   byte gettype(void) const
   {
-    return PLUGIN_TYPE_REDRAW   | PLUGIN_TYPE_DIRECTION |
+    return PLUGIN_TYPE_REDRAW   | PLUGIN_TYPE_DIRECTION | PLUGIN_TYPE_SPARSE |
            PLUGIN_TYPE_TRIGGER  | PLUGIN_TYPE_NEGFORCE  |
            PLUGIN_TYPE_USEFORCE | PLUGIN_TYPE_SENDFORCE;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     pixLength = pixlen;
     myid = id;
 
-    uint16_t maxheads = pixLength / 8; // one head for every 8 pixels up to 12
-    if (maxheads < 1) maxheads = 1; // but at least one
-    else if (maxheads > 12) maxheads = 12;
-
+    uint16_t maxheads = MaxHeads(pixLength);
     cdata = pixelNutComets.cometHeadCreate(maxheads);
     if ((cdata == NULL) && (maxheads > 1)) // try for at least 1
       cdata = pixelNutComets.cometHeadCreate(1);
@@ -73,6 +70,18 @@ public:
     firstime = true;
   }
 
+  void resize(uint16_t id, uint16_t pixlen)
+  {
+    pixelNutComets.cometHeadDelete(cdata);
+    begin(id, pixlen);
+  }
+
+  uint16_t getcost(uint16_t pixlen, uint32_t *pbytes)
+  {
+    *pbytes = pixelNutComets.cometHeadBytes(MaxHeads(pixlen));
+    return pixlen;
+  }
+
   void trigger(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, short force)
   {
     bool doit = true;
@@ -110,7 +119,15 @@ public:
   }
 
 private:
-  byte myid;
+  static uint16_t MaxHeads(uint16_t pixlen)
+  {
+    uint16_t maxheads = pixlen / 8; // one head for every 8 pixels up to 12
+    if (maxheads < 1) maxheads = 1; // but at least one
+    else if (maxheads > 12) maxheads = 12;
+    return maxheads;
+  }
+
+  uint16_t myid;
   bool firstime, repMode;
   short forceVal;
   uint16_t pixLength, headCount;
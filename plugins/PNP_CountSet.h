@@ -28,7 +28,7 @@ public:
     return PLUGIN_TYPE_TRIGGER | PLUGIN_TYPE_USEFORCE;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     pixLength = pixlen;
   }
@@ -38,7 +38,7 @@ public:
     if (force != 0)
     {
       force = abs(force);
-      pdraw->pixCount = pixelNutSupport.mapValue(force, 0, MAX_FORCE_VALUE, 1, pixLength);
+      pixelNutSupport.setPropCount(pdraw, pixelNutSupport.mapValue(force, 0, MAX_FORCE_VALUE, 1, pixLength));
     }
   }
 
@@ -32,7 +32,7 @@ public:
     return PLUGIN_TYPE_TRIGGER | PLUGIN_TYPE_USEFORCE;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     pixLength = pixlen;
     baseCount = 0; // causes set on next trigger
@@ -43,7 +43,7 @@ public:
   {
     if (!baseCount) baseCount = pdraw->pixCount;
 
-    pdraw->pixCount = pixelNutSupport.mapValue(abs(force), 0, MAX_FORCE_VALUE, baseCount, pixLength);
+    pixelNutSupport.setPropCount(pdraw, pixelNutSupport.mapValue(abs(force), 0, MAX_FORCE_VALUE, baseCount, pixLength));
 
     //pixelNutSupport.msgFormat(F("CountSurge: base=%d count=%d"), baseCount, pdraw->pixCount);
   }
@@ -52,7 +52,7 @@ public:
   {
     if ((pdraw->pixCount > baseCount) && ++stepCount/10)
     {
-      --pdraw->pixCount;
+      pixelNutSupport.setPropCount(pdraw, pdraw->pixCount-1);
       stepCount = 0;
     }
   }
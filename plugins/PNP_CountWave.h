@@ -27,6 +27,12 @@
 //    value to determine the modulation with a cosine function. The very first time
 //    this is called the median value is set to the current property value.
 //
+// Calling advance():
+//
+//    Adds up the angle for each step exactly as nextstep() does, but many steps at once
+//    except where a wave is completed, sending the force once if any were completed along
+//    the way, then sets the property for that step.
+//
 // Properties Used:
 //
 //    pixCount - used to set the median pixel count the very first call to nextstep().
@@ -45,7 +51,7 @@ public:
            PLUGIN_TYPE_NEGFORCE | PLUGIN_TYPE_SENDFORCE;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     myid = id;
     pixLength = pixlen; // total number of pixels
@@ -63,28 +69,51 @@ public:
     if (!baseValue) baseValue = pdraw->pixCount;
 
     int count = baseValue + (pixLength/2 * cos(angleNext));
-    if (count <= 0)             pdraw->pixCount = 1;
-    else if (count > pixLength) pdraw->pixCount = pixLength;
-    else                        pdraw->pixCount = count;
+    if (count <= 0)             count = 1;
+    else if (count > pixLength) count = pixLength;
+    pixelNutSupport.setPropCount(pdraw, count);
 
     //pixelNutSupport.msgFormat(F("CountWave: count=%d angle(*100)=%d"), pdraw->pixCount, (int)(angleNext*100));
 
-    angleNext += (RADIANS_PER_WAVE / 100) * ((float)forceVal / MAX_FORCE_VALUE);
+    if (AddAngle()) pixelNutSupport.sendForce(handle, myid, forceVal);
+  }
 
-    if (angleNext > RADIANS_PER_WAVE)
-    {
-      angleNext -= RADIANS_PER_WAVE;
-      pixelNutSupport.sendForce(handle, myid, forceVal);
-    }
-    else if (angleNext < 0)
+  bool repeats(void) { return false; } // adds up a float angle on each step
+
+  void advance(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, uint32_t steps)
+  {
+    if (!steps) return;
+
+    // the angle is added up for all but the last step, one step at a time only where
+    // it starts over, so that it's exactly what it would have been
+    uint32_t count = (steps-1);
+    bool wrapped = false;
+    while ((count -= pixelNutSupport.addFloatSteps(&angleNext, AngleStep(), count, 0, RADIANS_PER_WAVE)) > 0)
     {
-      angleNext += RADIANS_PER_WAVE;
-      pixelNutSupport.sendForce(handle, myid, forceVal);
+      AddAngle(); // starts over at the other end
+      wrapped = true;
+      --count;
     }
+    if (wrapped) pixelNutSupport.sendForce(handle, myid, forceVal);
+
+    nextstep(handle, pdraw);
   }
 
 private:
-  byte myid;
+  // adds the angle for a step, starting over at the other end if it goes past either
+  // end of the wave, and returns true if it did
+  bool AddAngle(void)
+  {
+    angleNext += AngleStep();
+    if (angleNext > RADIANS_PER_WAVE) angleNext -= RADIANS_PER_WAVE;
+    else if (angleNext < 0) angleNext += RADIANS_PER_WAVE;
+    else return false;
+    return true;
+  }
+
+  float AngleStep(void) { return (RADIANS_PER_WAVE / 100) * ((float)forceVal / MAX_FORCE_VALUE); }
+
+  uint16_t myid;
   short forceVal, baseValue;
   uint16_t pixLength;
   float angleNext;
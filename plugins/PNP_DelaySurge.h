@@ -42,7 +42,7 @@ public:
     return PLUGIN_TYPE_TRIGGER | PLUGIN_TYPE_USEFORCE;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     maxDelay = -1;
   }
@@ -10,6 +10,10 @@
 //
 //    Draws all pixels to the same color.
 //
+// Calling fusedstep():
+//
+//    Same as nextstep(), but makes the pixel values only once (used by fused kernels).
+//
 // Properties Used:
 //
 //    pcentBright - the brightness.
@@ -28,7 +32,7 @@ public:
     return PLUGIN_TYPE_REDRAW | PLUGIN_TYPE_DIRECTION;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     pixLength = pixlen;
   }
@@ -39,6 +43,12 @@ public:
       pixelNutSupport.setPixel(handle, i, pdraw->r, pdraw->g, pdraw->b);
   }
 
+  void fusedstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
+  {
+    byte bright = pixelNutSupport.scaleBright(handle, 1.0);
+    pixelNutSupport.fillPixels(handle, 0, pixLength-1, pdraw->r, pdraw->g, pdraw->b, bright);
+  }
+
 private:
   uint16_t pixLength;
 };
@@ -32,7 +32,7 @@ public:
     return PLUGIN_TYPE_REDRAW | PLUGIN_TYPE_DIRECTION | PLUGIN_TYPE_NEGFORCE | PLUGIN_TYPE_SENDFORCE;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     myid = id;
     pixLength = pixlen;
@@ -77,7 +77,7 @@ public:
   }
 
 private:
-  byte myid;
+  uint16_t myid;
   bool doDraw;
   short forceVal;
   uint16_t pixLength, curPos;
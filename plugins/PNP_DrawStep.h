@@ -29,7 +29,7 @@ public:
     return PLUGIN_TYPE_REDRAW | PLUGIN_TYPE_NEGFORCE | PLUGIN_TYPE_SENDFORCE | PLUGIN_TYPE_DIRECTION;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     myid = id;
     pixLength = pixlen;
@@ -55,7 +55,7 @@ public:
   }
 
 private:
-  byte myid;
+  uint16_t myid;
   short forceVal;
   uint16_t pixLength, curPos;
 };
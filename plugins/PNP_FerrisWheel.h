@@ -11,6 +11,15 @@
 //
 //    Advances the effect by one pixel, by redrawing all of the pixels.
 //
+// Calling advance():
+//
+//    Moves the spokes directly to their position for the last step, then draws them.
+//
+// Calling fusedstep():
+//
+//    Same as nextstep(), but clears all of the pixels at once, then draws only the spokes
+//    (used by fused kernels).
+//
 // Properties Used:
 //
 //    r,g,b - the current color values.
@@ -29,7 +38,7 @@ public:
     return PLUGIN_TYPE_REDRAW | PLUGIN_TYPE_DIRECTION;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     pixLength = pixlen;
     lastCount = 0;
@@ -37,22 +46,7 @@ public:
 
   void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
   {
-    if (lastCount != pdraw->pixCount)
-    {
-      lastCount = pdraw->pixCount;
-      uint16_t spokeCount = lastCount;
-      spaceCount = (pixLength - spokeCount);
-      if (!spaceCount)
-      {
-        spaceCount = 1;
-        spokeCount--;
-      }
-      spokeSpaces = spaceCount / spokeCount;
-      if (spaceCount % spokeCount) ++spokeSpaces;
-      spaceCount = 0;
-
-      //pixelNutSupport.msgFormat(F("Ferris: count=%d spaces=%d"), spokeCount, spokeSpaces);
-    }
+    SetSpacing(pdraw);
 
     uint16_t count = spaceCount;
 
@@ -70,6 +64,55 @@ public:
       spaceCount = 0;
   }
 
+  void fusedstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
+  {
+    SetSpacing(pdraw);
+
+    // unlit pixels are all 0 however they're drawn, and the spokes are all the same
+    byte bright = pixelNutSupport.scaleBright(handle, 1.0);
+    pixelNutSupport.clearPixels(handle, 0, pixLength-1);
+
+    for (uint32_t i = spaceCount; i < pixLength; i += (spokeSpaces + 1))
+      pixelNutSupport.fillPixels(handle, i, i, pdraw->r, pdraw->g, pdraw->b, bright);
+
+    if (++spaceCount > spokeSpaces)
+      spaceCount = 0;
+  }
+
+  void advance(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, uint32_t steps)
+  {
+    if (!steps) return;
+    nextstep(handle, pdraw); // sets the spacing if the count has changed
+
+    // the spokes repeat every (spokeSpaces+1) steps, so skip all but the last one
+    if (--steps)
+    {
+      spaceCount = (spaceCount + (steps-1)) % (spokeSpaces + 1);
+      nextstep(handle, pdraw);
+    }
+  }
+
 private:
+  // sets the spacing between the spokes if the count has changed
+  void SetSpacing(PixelNutSupport::DrawProps *pdraw)
+  {
+    if (lastCount != pdraw->pixCount)
+    {
+      lastCount = pdraw->pixCount;
+      uint16_t spokeCount = lastCount;
+      spaceCount = (pixLength - spokeCount);
+      if (!spaceCount)
+      {
+        spaceCount = 1;
+        if (spokeCount > 1) spokeCount--; // unless only a single pixel
+      }
+      spokeSpaces = spaceCount / spokeCount;
+      if (spaceCount % spokeCount) ++spokeSpaces;
+      spaceCount = 0;
+
+      //pixelNutSupport.msgFormat(F("Ferris: count=%d spaces=%d"), spokeCount, spokeSpaces);
+    }
+  }
+
   uint16_t pixLength, lastCount, spokeSpaces, spaceCount;
 };
@@ -0,0 +1,61 @@
+// What Effect Does:
+//
+//    Draws a rainbow of colors that moves down the drawing window, by changing the color hue
+//    a little for each pixel, starting with the current hue. The whiteness and brightness
+//    are the same for all pixels.
+//
+//    The pixel count property determines how many times the entire color wheel is repeated
+//    within the drawing window: a count of 1 (the default) creates a single rainbow.
+//
+// Calling trigger():
+//
+//    Not instantiated.
+//
+// Calling nextstep():
+//
+//    Draws all pixels, then advances the starting hue by the amount of one pixel.
+//
+// Properties Used:
+//
+//    degreeHue - starting hue of the rainbow.
+//    pcentWhite, pcentBright - used for all of the pixels.
+//    pixCount - determines how many rainbows are drawn.
+//
+// Properties Affected:
+//
+//    none
+//
+
+class PNP_HueGradient : public PixelNutPlugin
+{
+public:
+  byte gettype(void) const
+  {
+    return PLUGIN_TYPE_REDRAW | PLUGIN_TYPE_DIRECTION;
+  };
+
+  void begin(uint16_t id, uint16_t pixlen)
+  {
+    pixLength = pixlen;
+    hueOffset = 0;
+  }
+
+  void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
+  {
+    uint32_t maxhue = (uint32_t)(MAX_DEGREES_HUE+1) * HUE_STEP_SCALE;
+    int32_t step = (maxhue * pdraw->pixCount) / pixLength;
+
+    byte sat = MAX_PERCENTAGE - pdraw->pcentWhite;
+    byte val = ((uint16_t)pdraw->pcentBright * MAX_BYTE_VALUE) / MAX_PERCENTAGE;
+    uint32_t hue = ((uint32_t)pdraw->degreeHue * HUE_STEP_SCALE) + hueOffset;
+
+    pixelNutSupport.setPixelsHue(handle, 0, pixLength-1, hue, step, sat, val);
+
+    // subtracting causes "forward" motion
+    hueOffset = (hueOffset + maxhue - (step % maxhue)) % maxhue;
+  }
+
+private:
+  uint16_t pixLength;
+  uint32_t hueOffset;
+};
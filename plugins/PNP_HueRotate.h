@@ -19,6 +19,12 @@
 //    Sets the current drawing color and then advances the hue by some amount that was
 //    determined by the force in the previous call to trigger().
 //
+// Calling advance():
+//
+//    Calculates the hue for the last step without taking each step (whole passes around the
+//    color wheel are skipped), then sets the drawing color from it. If the amount added each
+//    step is too small to change the hue any more, it stays where it is.
+//
 // Properties Used:
 //
 //    percentWhite, percentBright - current values used to create the drawing color.
@@ -36,19 +42,21 @@ public:
     return PLUGIN_TYPE_TRIGGER | PLUGIN_TYPE_USEFORCE;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     pixLength = pixlen;
     pixChanged = 0;
     curDegrees = 0.0;       // if trigger() not called then hue will be 0 (red)
     addDegrees = 0.0;       // which will not change until trigger() is called
     doResetAtEnd = false;
+    passSteps = 0;
   }
 
   void trigger(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, short force)
   {
     // change hue by at most the number of degrees that "fit" exactly into the number of pixels
     addDegrees = (((float)force / MAX_FORCE_VALUE) * (MAX_DEGREES_HUE / (float)pixLength));
+    passSteps = 0;
 
     if (abs(force) == MAX_FORCE_VALUE)
     {
@@ -64,24 +72,91 @@ public:
   {
     //pixelNutSupport.msgFormat(F("HueRotate: degrees=%d"), (int)curDegrees);
 
-    pdraw->degreeHue = (int)curDegrees;
-    pixelNutSupport.makeColorVals(pdraw);
+    if (pixelNutSupport.setPropHue(pdraw, (int)curDegrees))
+      pixelNutSupport.makeColorVals(pdraw);
 
     if (doResetAtEnd && (++pixChanged >= pixLength))
     {
       pixChanged = 0;
       curDegrees = 0.0;
     }
-    else
+    else AddDegrees();
+  }
+
+  bool repeats(void) { return false; } // adds up float degrees on each step
+
+  void advance(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, uint32_t steps)
+  {
+    if (!steps) return;
+    --steps; // skip all but the last step
+
+    if (doResetAtEnd)
     {
-      curDegrees += addDegrees;
-      if (curDegrees > MAX_DEGREES_HUE) curDegrees = 0;
-      else if (curDegrees < 0) curDegrees = MAX_DEGREES_HUE;
+      uint32_t toreset = (pixLength - pixChanged);
+      if (steps >= toreset) // goes back to 0 each time the pixel count is reached
+      {
+        steps = (steps - toreset) % pixLength;
+        pixChanged = 0;
+        curDegrees = 0.0;
+      }
+      pixChanged += steps;
     }
+    AddDegrees(steps);
+
+    nextstep(handle, pdraw);
   }
 
 private:
+  // adds 'addDegrees' to the current hue, starting over at the other end if it goes
+  // past either end, and returns true if it did
+  bool AddDegrees(void)
+  {
+    curDegrees += addDegrees;
+    if (curDegrees > MAX_DEGREES_HUE) curDegrees = 0;
+    else if (curDegrees < 0) curDegrees = MAX_DEGREES_HUE;
+    else return false;
+    return true;
+  }
+
+  // adds 'addDegrees' up to 'times' times, stopping after it starts over at either end,
+  // and returns the number of times it was added (setting 'pwrapped' if it started over)
+  uint32_t AddDegrees(uint32_t times, bool *pwrapped)
+  {
+    uint32_t count = pixelNutSupport.addFloatSteps(&curDegrees, addDegrees, times, 0, MAX_DEGREES_HUE);
+    *pwrapped = (count < times);
+    if (*pwrapped)
+    {
+      AddDegrees();
+      ++count;
+    }
+    return count;
+  }
+
+  // adds 'addDegrees' the number of 'times': once it has started over, each pass around
+  // the color wheel takes the same number of steps, so all of the whole passes are skipped
+  void AddDegrees(uint32_t times)
+  {
+    if (addDegrees == 0.0) return;
+
+    bool wrapped;
+    times -= AddDegrees(times, &wrapped);
+    if (!wrapped) return;
+
+    if (!passSteps)
+    {
+      float degrees = curDegrees;
+      uint32_t steps = AddDegrees(UINT32_MAX, &wrapped);
+      curDegrees = degrees;
+      if (!wrapped) steps = 0; // stuck before it got around, so never starts over again
+      passSteps = steps;
+    }
+
+    if (passSteps) times %= passSteps;
+    AddDegrees(times, &wrapped);
+  }
+
   bool doResetAtEnd;
   uint16_t pixLength, pixChanged;
   float addDegrees, curDegrees;
+  uint32_t passSteps;     // number of steps in each pass around the color wheel (0 if not known)
 };
@@ -34,9 +34,8 @@ public:
   void trigger(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, short force)
   {
     force = abs(force);
-    pdraw->degreeHue = (uint16_t)(((float)force / MAX_FORCE_VALUE) * MAX_DEGREES_HUE);
-
-    pixelNutSupport.makeColorVals(pdraw);
+    if (pixelNutSupport.setPropHue(pdraw, (uint16_t)(((float)force / MAX_FORCE_VALUE) * MAX_DEGREES_HUE)))
+      pixelNutSupport.makeColorVals(pdraw);
 
     //pixelNutSupport.msgFormat(F("SetTheHue: hue=%d"), pdraw->degreeHue);
   }
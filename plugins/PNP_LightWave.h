@@ -14,6 +14,16 @@
 //
 //    Draws each pixel, scaling the brightness up/down from the current value.
 //
+// Calling advance():
+//
+//    Moves the starting angle of the wave for each step exactly as nextstep() does, but
+//    many steps at once except where it starts over, then draws the last step.
+//
+// Calling fusedstep():
+//
+//    Same as nextstep(), but draws each run of pixels with the same brightness at once
+//    (used by fused kernels).
+//
 // Properties Used:
 //
 //    r,g,b - the current color values.
@@ -32,17 +42,22 @@ public:
     return PLUGIN_TYPE_REDRAW | PLUGIN_TYPE_DIRECTION;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     myid = id;
     pixLength = pixlen;
     angleNext = 0.0; // starting angle
   }
 
+  uint16_t getcost(uint16_t pixlen, uint32_t *pbytes)
+  {
+    *pbytes = 0;
+    return (pixlen * 4); // calculates a cosine for each pixel
+  }
+
   void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
   {
-    uint16_t count = (pixLength - pdraw->pixCount + 1);
-    float angle_step = (RADIANS_PER_WAVE / 10.0) * ((float)count / pixLength);
+    float angle_step = AngleStep(pdraw);
     float angle = angleNext;
 
     for (uint16_t i = 0; i < pixLength; ++i, angle += angle_step)
@@ -54,12 +69,69 @@ public:
     }
     //pixelNutSupport.msgFormat(F("LightWave: angleNext * 100 = %d"), (int)(angleNext * 100));
 
+    MoveAngle(angle_step);
+  }
+
+  void fusedstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
+  {
+    float angle_step = AngleStep(pdraw);
+    float angle = angleNext;
+
+    // the wave changes slowly, so neighboring pixels often end up with the same values
+    uint16_t start = 0;
+    byte runbright = 0;
+
+    for (uint16_t i = 0; i < pixLength; ++i, angle += angle_step)
+    {
+      float scale = ((cos(angle) + 1.0) / 4.0) + 0.5; // same as nextstep()
+      byte bright = pixelNutSupport.scaleBright(handle, scale);
+
+      if (!i) runbright = bright;
+      else if (bright != runbright)
+      {
+        pixelNutSupport.fillPixels(handle, start, i-1, pdraw->r, pdraw->g, pdraw->b, runbright);
+        runbright = bright;
+        start = i;
+      }
+    }
+    pixelNutSupport.fillPixels(handle, start, pixLength-1, pdraw->r, pdraw->g, pdraw->b, runbright);
+
+    MoveAngle(angle_step);
+  }
+
+  bool repeats(void) { return false; } // adds up a float angle on each step
+
+  void advance(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, uint32_t steps)
+  {
+    if (!steps) return;
+
+    // the angle is moved for all but the last step, one step at a time only where it
+    // starts over, so that it's exactly what it would have been (it only goes down)
+    float angle_step = AngleStep(pdraw);
+    uint32_t count = (steps-1);
+    while ((count -= pixelNutSupport.addFloatSteps(&angleNext, -angle_step, count, 0, (2 * RADIANS_PER_WAVE))) > 0)
+    {
+      MoveAngle(angle_step); // starts over at the end of the wave
+      --count;
+    }
+
+    nextstep(handle, pdraw);
+  }
+
+private:
+  void MoveAngle(float angle_step)
+  {
     angleNext -= angle_step; // subtracting causes "forward" motion
     if (angleNext < 0) angleNext += RADIANS_PER_WAVE;
   }
 
-private:
-  byte myid;
+  float AngleStep(PixelNutSupport::DrawProps *pdraw)
+  {
+    uint16_t count = (pixLength - pdraw->pixCount + 1);
+    return (RADIANS_PER_WAVE / 10.0) * ((float)count / pixLength);
+  }
+
+  uint16_t myid;
   uint16_t pixLength;
   float angleNext;
 };
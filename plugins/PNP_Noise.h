@@ -30,7 +30,7 @@ public:
     return PLUGIN_TYPE_REDRAW;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     pixLength = pixlen;
   }
@@ -46,10 +46,10 @@ public:
     for (uint16_t i = 0; i < pdraw->pixCount; ++i)
     {
       // set random brightness within limits (>= 10%)
-      p.pcentBright = random(10, pdraw->pcentBright+1);
+      p.pcentBright = pixelNutSupport.randomValue(10, pdraw->pcentBright+1);
       pixelNutSupport.makeColorVals(&p);
 
-      short pos = random(0, pixLength);
+      short pos = pixelNutSupport.randomValue(0, pixLength);
       pixelNutSupport.setPixel(handle, pos, p.r, p.g, p.b);
     }
   }
@@ -0,0 +1,55 @@
+// What Effect Does:
+//
+//    Blurs the output pixels after all of the tracks have been merged together, by averaging
+//    each pixel with its neighbors on both sides. The trigger force determines how many pixels
+//    on each side are used, from 1 up to MAX_BLUR_RADIUS.
+//
+//    This is a postdraw effect: it applies to all of the tracks in the segment it is added to.
+//
+// Calling trigger():
+//
+//    Sets the blur radius from the force value.
+//
+// Calling nextstep():
+//
+//    Blurs all of the output pixels.
+//
+// Properties Used:
+//
+//    none
+//
+// Properties Affected:
+//
+//    none
+//
+
+class PNP_PostBlur : public PixelNutPlugin
+{
+public:
+  byte gettype(void) const
+  {
+    return PLUGIN_TYPE_POSTDRAW | PLUGIN_TYPE_TRIGGER | PLUGIN_TYPE_USEFORCE;
+  };
+
+  void begin(uint16_t id, uint16_t pixlen)
+  {
+    pixLength = pixlen;
+    radius = 1;
+  }
+
+  void trigger(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, short force)
+  {
+    radius = 1 + (((long)abs(force) * (MAX_BLUR_RADIUS-1)) / MAX_FORCE_VALUE);
+
+    //pixelNutSupport.msgFormat(F("PostBlur: force=%d radius=%d"), force, radius);
+  }
+
+  void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
+  {
+    pixelNutSupport.blurPixels(handle, 0, pixLength-1, radius);
+  }
+
+private:
+  uint16_t pixLength;
+  byte radius;
+};
@@ -0,0 +1,72 @@
+// What Effect Does:
+//
+//    Creates a kaleidoscope of the output pixels after all of the tracks have been merged
+//    together, by repeating the first section of pixels along the rest of the strip, with
+//    every other copy of it reversed. The trigger force determines how many sections there are.
+//
+//    This is a postdraw effect: it applies to all of the tracks in the segment it is added to.
+//
+// Calling trigger():
+//
+//    Sets the number of sections from the force value, from 2 up to 'maxSections'.
+//
+// Calling nextstep():
+//
+//    Copies the first section of the output pixels onto all of the other sections.
+//
+// Properties Used:
+//
+//    none
+//
+// Properties Affected:
+//
+//    none
+//
+
+class PNP_PostKaleido : public PixelNutPlugin
+{
+public:
+  byte gettype(void) const
+  {
+    return PLUGIN_TYPE_POSTDRAW | PLUGIN_TYPE_TRIGGER | PLUGIN_TYPE_USEFORCE;
+  };
+
+  void begin(uint16_t id, uint16_t pixlen)
+  {
+    pixLength = pixlen;
+    SetSections(2);
+  }
+
+  void trigger(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, short force)
+  {
+    SetSections(2 + (((long)abs(force) * (maxSections-2)) / MAX_FORCE_VALUE));
+
+    //pixelNutSupport.msgFormat(F("PostKaleido: force=%d seclen=%d"), force, secLength);
+  }
+
+  void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
+  {
+    if (!secLength) return;
+
+    bool reverse = true;
+    for (uint16_t pos = secLength; pos < pixLength; pos += secLength, reverse = !reverse)
+    {
+      uint16_t count = secLength;
+      if ((pos + count) > pixLength) count = pixLength - pos; // last section may be partial
+
+      if (reverse)
+           pixelNutSupport.mirrorPixels(handle, (secLength - count), secLength-1, pos);
+      else pixelNutSupport.movePixels(handle, 0, count-1, pos);
+    }
+  }
+
+private:
+  static const uint16_t maxSections = 8; // most sections the pixels are divided into
+
+  uint16_t pixLength, secLength;
+
+  void SetSections(uint16_t count)
+  {
+    secLength = pixLength / count;
+  }
+};
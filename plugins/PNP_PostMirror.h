@@ -0,0 +1,51 @@
+// What Effect Does:
+//
+//    Mirrors one half of the output pixels onto the other half, after all of the tracks have
+//    been merged together. The drawing direction of the track determines which half is copied:
+//    if upwards the first half is reflected onto the second half, else the other way around.
+//
+//    This is a postdraw effect: it applies to all of the tracks in the segment it is added to.
+//
+// Calling trigger():
+//
+//    Not instantiated.
+//
+// Calling nextstep():
+//
+//    Copies one half of the output pixels in reverse order onto the other half.
+//
+// Properties Used:
+//
+//    goUpwards - determines which half of the pixels is copied.
+//
+// Properties Affected:
+//
+//    none
+//
+
+class PNP_PostMirror : public PixelNutPlugin
+{
+public:
+  byte gettype(void) const
+  {
+    return PLUGIN_TYPE_POSTDRAW | PLUGIN_TYPE_DIRECTION;
+  };
+
+  void begin(uint16_t id, uint16_t pixlen)
+  {
+    pixLength = pixlen;
+  }
+
+  void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
+  {
+    uint16_t half = pixLength >> 1; // middle pixel is left alone if odd length
+    if (!half) return;
+
+    if (pdraw->goUpwards)
+         pixelNutSupport.mirrorPixels(handle, 0, half-1, (pixLength - half));
+    else pixelNutSupport.mirrorPixels(handle, (pixLength - half), pixLength-1, 0);
+  }
+
+private:
+  uint16_t pixLength;
+};
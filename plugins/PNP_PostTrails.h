@@ -0,0 +1,75 @@
+// What Effect Does:
+//
+//    Creates persistent trails behind anything that moves, by keeping a copy of the previous
+//    output pixels that slowly fades away, which shows through wherever it's brighter than
+//    the newly merged pixels. The trigger force determines how slowly the trails fade.
+//    Allocates 3 bytes of memory per number of pixels.
+//
+//    This is a postdraw effect: it applies to all of the tracks in the segment it is added to.
+//
+// Calling trigger():
+//
+//    Sets the rate of fading from the force value: the more force the longer the trails.
+//
+// Calling nextstep():
+//
+//    Fades the previous pixels and merges them with the output pixels.
+//
+// Properties Used:
+//
+//    none
+//
+// Properties Affected:
+//
+//    none
+//
+
+class PNP_PostTrails : public PixelNutPlugin
+{
+public:
+  ~PNP_PostTrails() { if (phistory != NULL) pixelNutSupport.memFree(phistory); }
+
+  byte gettype(void) const
+  {
+    return PLUGIN_TYPE_POSTDRAW | PLUGIN_TYPE_TRIGGER | PLUGIN_TYPE_USEFORCE;
+  };
+
+  void begin(uint16_t id, uint16_t pixlen)
+  {
+    pixLength = pixlen;
+    decay = 0;
+
+    phistory = (byte*)pixelNutSupport.memAlloc(pixLength * PIXEL_CHANNELS);
+    if (phistory != NULL) memset(phistory, 0, (pixLength * PIXEL_CHANNELS));
+  }
+
+  void resize(uint16_t id, uint16_t pixlen)
+  {
+    if (phistory != NULL) pixelNutSupport.memFree(phistory);
+    begin(id, pixlen);
+  }
+
+  uint16_t getcost(uint16_t pixlen, uint32_t *pbytes)
+  {
+    *pbytes = (pixlen * PIXEL_CHANNELS); // allocated in begin()
+    return pixlen;
+  }
+
+  void trigger(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw, short force)
+  {
+    // keep from 50% up to about 97% of the previous values on each step
+    decay = 128 + (((long)abs(force) * 120) / MAX_FORCE_VALUE);
+
+    //pixelNutSupport.msgFormat(F("PostTrails: force=%d decay=%d"), force, decay);
+  }
+
+  void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
+  {
+    pixelNutSupport.persistPixels(handle, 0, pixLength-1, phistory, decay);
+  }
+
+private:
+  uint16_t pixLength;
+  byte decay;
+  byte *phistory;
+};
@@ -26,23 +26,35 @@
 class PNP_Twinkle : public PixelNutPlugin
 {
 public:
-  ~PNP_Twinkle() { if (pbytes != NULL) free(pbytes); }
+  ~PNP_Twinkle() { if (pbytes != NULL) pixelNutSupport.memFree(pbytes); }
 
   byte gettype(void) const
   {
     return PLUGIN_TYPE_REDRAW;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     pixLength = pixlen;
-    pbytes = (int16_t*)malloc(pixLength * sizeof(int16_t));
+    pbytes = (int16_t*)pixelNutSupport.memAlloc(pixLength * sizeof(int16_t));
 
     maxvalue = 50;
 
     if (pbytes != NULL)
       for (uint16_t i = 0; i < pixLength; ++i)
-        pbytes[i] = random(0, ((maxvalue * 2) + maxvalue)) - maxvalue;
+        pbytes[i] = pixelNutSupport.randomValue(0, ((maxvalue * 2) + maxvalue)) - maxvalue;
+  }
+
+  void resize(uint16_t id, uint16_t pixlen)
+  {
+    if (pbytes != NULL) pixelNutSupport.memFree(pbytes);
+    begin(id, pixlen);
+  }
+
+  uint16_t getcost(uint16_t pixlen, uint32_t *pnumbytes)
+  {
+    *pnumbytes = (pixlen * sizeof(int16_t)); // allocated in begin()
+    return pixlen;
   }
 
   void nextstep(PixelNutHandle handle, PixelNutSupport::DrawProps *pdraw)
@@ -97,7 +109,7 @@ public:
         }
         else if (++(pbytes[i]) == 0)
         {
-          pbytes[i] = maxvalue + random(10, 60); // go dark for random time
+          pbytes[i] = maxvalue + pixelNutSupport.randomValue(10, 60); // go dark for random time
           doscale = false;
         }
         else if (pbytes[i] == maxvalue)
@@ -29,7 +29,7 @@ public:
     return PLUGIN_TYPE_NEGFORCE | PLUGIN_TYPE_SENDFORCE;
   };
 
-  void begin(byte id, uint16_t pixlen)
+  void begin(uint16_t id, uint16_t pixlen)
   {
     myid = id;
     forceVal = 0;
@@ -87,7 +87,7 @@ public:
   }
 
 private:
-  byte myid;
+  uint16_t myid;
   short forceVal;
   bool goForward;
   int16_t pixCenter, headPos, tailPos;
@@ -10,6 +10,7 @@
 
 // Routines for drawing comets effects:
 // Create: assigns data space to hold requested heads, returns NULL if failed
+// Bytes: returns the number of bytes that Create allocates for that many heads
 // Delete: must be called by plugin destructor to clean up any memory allocated
 // Add: creates new head, or overwrites old one if already reached the maximum
 //      ('dowrap' controls whether or not comet wraps around, or falls off end)
@@ -22,9 +23,10 @@ class PixelNutComets
 public:
     typedef void (*cometData); // abstracts internal data used for heads
     cometData cometHeadCreate(uint16_t headcount);
+    uint16_t cometHeadBytes(uint16_t headcount);
     void cometHeadDelete(cometData cdata);
-    int cometHeadAdd(cometData cdata, byte layer, bool dowrap, uint16_t pixlen);
-    int cometHeadDraw(cometData cdata, byte layer,
+    int cometHeadAdd(cometData cdata, uint16_t layer, bool dowrap, uint16_t pixlen);
+    int cometHeadDraw(cometData cdata, uint16_t layer,
           PixelNutSupport::DrawProps *pdraw, PixelNutHandle handle, uint16_t pixlen);
 };
 